@@ -2,26 +2,421 @@
 
 #include <arpa/inet.h>
 #include <netdb.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <unistd.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define KVS_FORM_SIMD 1
+#else
+#define KVS_FORM_SIMD 0
+#endif
+
 #include <algorithm>
+#include <charconv>
 #include <chrono>
 #include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <coroutine>
+#include <cstdio>
+#include <cstring>
 #include <filesystem>
-#include <iomanip>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <limits>
+#include <map>
 #include <memory>
-#include <random>
+#include <optional>
+#include <set>
 #include <sstream>
+#include <string_view>
+#include <type_traits>
+#include <utility>
 
+#include <rocksdb/cache.h>
+#include <rocksdb/compaction_filter.h>
 #include <rocksdb/db.h>
+#include <rocksdb/filter_policy.h>
+#include <rocksdb/merge_operator.h>
 #include <rocksdb/options.h>
+#include <rocksdb/sst_file_writer.h>
+#include <rocksdb/table.h>
+#include <rocksdb/utilities/checkpoint.h>
 #include <rocksdb/write_batch.h>
 
 namespace kvs {
+
+// Lets one thread abort another's in-flight post(): Cancel() shuts the socket
+// down so a blocked send/recv returns at once. The mutex keeps the fd from
+// being closed (and its number reused) underneath Cancel().
+struct CallCancel {
+  std::mutex mu;
+  int fd = -1;
+  bool cancelled = false;
+
+  bool Attach(int s) {
+    std::lock_guard<std::mutex> lk(mu);
+    fd = cancelled ? -1 : s;
+    return !cancelled;
+  }
+  void Detach() {
+    std::lock_guard<std::mutex> lk(mu);
+    fd = -1;
+  }
+  void Cancel() {
+    std::lock_guard<std::mutex> lk(mu);
+    cancelled = true;
+    if (fd >= 0) {
+      shutdown(fd, SHUT_RDWR);
+    }
+  }
+  bool Cancelled() {
+    std::lock_guard<std::mutex> lk(mu);
+    return cancelled;
+  }
+};
+
+// Engine-wide work-stealing executor. Each worker owns a deque: it pushes and
+// pops its own tasks at the back (newest first, still warm in its cache) and
+// an idle worker steals from the front of another's. Tasks posted from
+// outside the pool (the accept loop) go through a shared inject queue, taken
+// only after stolen work so in-flight requests finish before new ones start.
+//
+// Write paths block on peer sockets, fsync and queues (read handlers are
+// coroutines and park on the EventLoop instead). A worker about to block
+// opens an Executor::Blocking scope; while fewer than `threads` workers are
+// runnable and work is queued, a parked spare is woken (or, up to
+// max_threads, started) to take its place. Spares idle for kSpareIdleMs exit,
+// so a burst does not leave threads behind and steady load reuses them.
+// Future::Get() first runs the waiter's own queued tasks, so a fan-out never
+// waits on children nobody has picked up.
+class Executor {
+ public:
+  template <class T>
+  class Future;
+
+  Executor(int threads, int max_threads)
+      : threads_(std::max(1, threads)),
+        max_threads_(std::max(threads_, max_threads)),
+        workers_(new Worker[max_threads_]) {
+    std::lock_guard<std::mutex> lk(mu_);
+    for (int i = 0; i < threads_; i++) {
+      Spawn();
+    }
+  }
+  ~Executor() { Shutdown(); }
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  // Fire and forget.
+  void Post(std::function<void()> task) { Push(std::move(task)); }
+
+  template <class F>
+  Future<std::invoke_result_t<F&>> Async(F&& f);
+
+  // Runs body(i) for every i in [0, n): n - 1 tasks plus the caller, which
+  // takes index 0 and returns once all of them are done.
+  template <class F>
+  void ParallelFor(size_t n, F&& body);
+
+  // Runs what is queued, then stops and joins every worker. Tasks still
+  // blocked hold Shutdown() until they return.
+  void Shutdown() {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      if (stopping_) {
+        return;
+      }
+      stopping_ = true;
+    }
+    cv_.notify_all();
+    for (int i = 0; i < max_threads_; i++) {
+      if (workers_[i].th.joinable()) {
+        workers_[i].th.join();
+      }
+    }
+  }
+
+  // Marks the calling worker as blocked for the scope's lifetime; a no-op on
+  // threads outside any executor.
+  class Blocking {
+   public:
+    Blocking() : exec_(current_) {
+      if (exec_) {
+        exec_->blocked_.fetch_add(1, std::memory_order_seq_cst);
+        exec_->Wake();
+      }
+    }
+    ~Blocking() {
+      if (exec_) {
+        exec_->blocked_.fetch_sub(1, std::memory_order_seq_cst);
+      }
+    }
+    Blocking(const Blocking&) = delete;
+    Blocking& operator=(const Blocking&) = delete;
+
+   private:
+    Executor* exec_;
+  };
+
+  std::vector<std::pair<std::string, std::string>> Stats() const {
+    return {
+        {"threads", std::to_string(threads_)},
+        {"max_threads", std::to_string(max_threads_)},
+        {"live", std::to_string(live_.load(std::memory_order_relaxed))},
+        {"blocked", std::to_string(blocked_.load(std::memory_order_relaxed))},
+        {"idle", std::to_string(idle_.load(std::memory_order_relaxed))},
+        {"queued", std::to_string(queued_.load(std::memory_order_relaxed))},
+        {"executed", std::to_string(executed_.load(std::memory_order_relaxed))},
+        {"steals", std::to_string(steals_.load(std::memory_order_relaxed))},
+        {"spawned", std::to_string(spawned_.load(std::memory_order_relaxed))},
+    };
+  }
+
+ private:
+  using Task = std::function<void()>;
+  static constexpr int kSpareIdleMs = 2000;
+
+  struct Worker {
+    std::mutex mu;
+    std::deque<Task> tasks;
+    std::thread th;
+    bool used = false;  // under Executor::mu_
+  };
+
+  void Push(Task task) {
+    if (current_ == this && self_) {
+      std::lock_guard<std::mutex> lk(self_->mu);
+      self_->tasks.push_back(std::move(task));
+    } else {
+      std::lock_guard<std::mutex> lk(inject_mu_);
+      inject_.push_back(std::move(task));
+    }
+    queued_.fetch_add(1, std::memory_order_seq_cst);
+    Wake();
+  }
+
+  // A parked worker is woken if there is one; otherwise a new one starts
+  // while fewer than threads_ are runnable. idle_ is raised under mu_ before
+  // a parker checks queued_, so a push either is seen or sees the parker.
+  void Wake() {
+    if (queued_.load(std::memory_order_seq_cst) <= 0) {
+      return;
+    }
+    if (idle_.load(std::memory_order_seq_cst) > 0) {
+      std::lock_guard<std::mutex> lk(mu_);
+      cv_.notify_one();
+      return;
+    }
+    if (live_.load(std::memory_order_relaxed) - blocked_.load(std::memory_order_relaxed) >= threads_) {
+      return;
+    }
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!stopping_ && idle_.load(std::memory_order_relaxed) == 0 &&
+        live_.load(std::memory_order_relaxed) - blocked_.load(std::memory_order_relaxed) < threads_) {
+      Spawn();
+    }
+  }
+
+  // Called with mu_ held. A slot whose worker exited is joined and reused.
+  void Spawn() {
+    for (int i = 0; i < max_threads_; i++) {
+      Worker& w = workers_[i];
+      if (w.used) {
+        continue;
+      }
+      if (w.th.joinable()) {
+        w.th.join();
+      }
+      w.used = true;
+      live_.fetch_add(1, std::memory_order_relaxed);
+      spawned_.fetch_add(1, std::memory_order_relaxed);
+      slots_.store(std::max(slots_.load(std::memory_order_relaxed), i + 1), std::memory_order_release);
+      w.th = std::thread(&Executor::Run, this, &w);
+      return;
+    }
+  }
+
+  bool PopOwn(Task* task) {
+    if (current_ != this || !self_) {
+      return false;
+    }
+    std::lock_guard<std::mutex> lk(self_->mu);
+    if (self_->tasks.empty()) {
+      return false;
+    }
+    *task = std::move(self_->tasks.back());
+    self_->tasks.pop_back();
+    queued_.fetch_sub(1, std::memory_order_seq_cst);
+    return true;
+  }
+
+  bool Take(Worker* self, Task* task) {
+    if (PopOwn(task)) {
+      return true;
+    }
+    const int slots = slots_.load(std::memory_order_acquire);
+    const int start = (int)(self - workers_.get());
+    for (int k = 1; k < slots; k++) {
+      Worker& victim = workers_[(start + k) % slots];
+      std::lock_guard<std::mutex> lk(victim.mu);
+      if (!victim.tasks.empty()) {
+        *task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        queued_.fetch_sub(1, std::memory_order_seq_cst);
+        steals_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+      }
+    }
+    std::lock_guard<std::mutex> lk(inject_mu_);
+    if (inject_.empty()) {
+      return false;
+    }
+    *task = std::move(inject_.front());
+    inject_.pop_front();
+    queued_.fetch_sub(1, std::memory_order_seq_cst);
+    return true;
+  }
+
+  void Run(Worker* self) {
+    current_ = this;
+    self_ = self;
+    for (;;) {
+      Task task;
+      if (Take(self, &task)) {
+        task();
+        executed_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      std::unique_lock<std::mutex> lk(mu_);
+      idle_.fetch_add(1, std::memory_order_seq_cst);
+      const bool woke = cv_.wait_for(lk, std::chrono::milliseconds(kSpareIdleMs), [&]() {
+        return stopping_ || queued_.load(std::memory_order_seq_cst) > 0;
+      });
+      idle_.fetch_sub(1, std::memory_order_seq_cst);
+      if (woke && !stopping_) {
+        continue;
+      }
+      // Stopping with nothing queued, or a spare nobody needed.
+      const bool spare = live_.load(std::memory_order_relaxed) - blocked_.load(std::memory_order_relaxed) > threads_;
+      if (stopping_ ? queued_.load(std::memory_order_seq_cst) <= 0 : spare) {
+        self->used = false;
+        live_.fetch_sub(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+
+  const int threads_;
+  const int max_threads_;
+  std::unique_ptr<Worker[]> workers_;
+  std::atomic<int> slots_{0};
+  std::mutex inject_mu_;
+  std::deque<Task> inject_;
+  std::mutex mu_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+  std::atomic<int> live_{0}, blocked_{0}, idle_{0};
+  std::atomic<long> queued_{0}, executed_{0}, steals_{0}, spawned_{0};
+  static thread_local Executor* current_;
+  static thread_local Worker* self_;
+};
+
+thread_local Executor* Executor::current_ = nullptr;
+thread_local Executor::Worker* Executor::self_ = nullptr;
+
+template <class T>
+class Executor::Future {
+ public:
+  Future() = default;
+
+  bool Ready() const {
+    std::lock_guard<std::mutex> lk(state_->mu);
+    return state_->done;
+  }
+
+  // Helps with the caller's own queued tasks, then blocks until done.
+  void Wait() const {
+    while (!Ready()) {
+      Task task;
+      if (exec_->PopOwn(&task)) {
+        task();
+        exec_->executed_.fetch_add(1, std::memory_order_relaxed);
+        continue;
+      }
+      Blocking blocking;
+      std::unique_lock<std::mutex> lk(state_->mu);
+      state_->cv.wait(lk, [&]() { return state_->done; });
+    }
+  }
+
+  T Get() {
+    Wait();
+    if constexpr (!std::is_void_v<T>) {
+      return std::move(*state_->value);
+    }
+  }
+
+ private:
+  friend class Executor;
+  using Value = std::conditional_t<std::is_void_v<T>, char, T>;
+  struct State {
+    std::mutex mu;
+    std::condition_variable cv;
+    bool done = false;
+    std::optional<Value> value;
+  };
+  Future(Executor* exec, std::shared_ptr<State> state) : exec_(exec), state_(std::move(state)) {}
+
+  Executor* exec_ = nullptr;
+  std::shared_ptr<State> state_;
+};
+
+template <class F>
+Executor::Future<std::invoke_result_t<F&>> Executor::Async(F&& f) {
+  using T = std::invoke_result_t<F&>;
+  auto state = std::make_shared<typename Future<T>::State>();
+  Push([state, f = std::forward<F>(f)]() mutable {
+    std::optional<typename Future<T>::Value> v;
+    if constexpr (std::is_void_v<T>) {
+      f();
+      v.emplace();
+    } else {
+      v.emplace(f());
+    }
+    std::lock_guard<std::mutex> lk(state->mu);
+    state->value = std::move(v);
+    state->done = true;
+    state->cv.notify_all();
+  });
+  return Future<T>(this, std::move(state));
+}
+
+template <class F>
+void Executor::ParallelFor(size_t n, F&& body) {
+  if (n == 0) {
+    return;
+  }
+  std::vector<Future<void>> rest;
+  rest.reserve(n - 1);
+  for (size_t i = 1; i < n; i++) {
+    rest.push_back(Async([&body, i]() { body(i); }));
+  }
+  body(0);
+  for (auto& f : rest) {
+    f.Wait();
+  }
+}
+
 namespace {
 
 long now_ms() {
@@ -29,6 +424,33 @@ long now_ms() {
   return std::chrono::duration_cast<std::chrono::milliseconds>(now).count();
 }
 
+long elapsed_us(std::chrono::steady_clock::time_point started) {
+  return (long)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - started).count();
+}
+
+// Engine::LatencyHist buckets: exact below 4 us, then 4 per power of two.
+constexpr int kLatencyBuckets = 104;
+
+int latency_bucket(long us) {
+  if (us < 4) {
+    return (int)std::max(0L, us);
+  }
+  const int e = 63 - __builtin_clzll((unsigned long long)us);
+  const int sub = (int)((us >> (e - 2)) & 3);
+  return std::min(kLatencyBuckets - 1, 4 * (e - 1) + sub);
+}
+
+// Largest value that lands in bucket b.
+long latency_bucket_max(int b) {
+  if (b < 4) {
+    return b;
+  }
+  const int e = b / 4 + 1;
+  const long sub = b % 4;
+  return ((5 + sub) << (e - 2)) - 1;
+}
+
 uint64_t h64(const std::string& s) {
   uint64_t h = 1469598103934665603ULL;
   for (unsigned char c : s) {
@@ -62,47 +484,198 @@ int hexv(char c) {
   return -1;
 }
 
-std::string enc(const std::string& s) {
-  static const char* h = "0123456789ABCDEF";
-  std::string out;
-  out.reserve(s.size() * 2);
+// Form codec kernels. enc_append()/dec_append() copy runs of bytes that need no escaping in
+// bulk; the kernels only report how long the run at p is. The AVX2 / SSE4.2
+// variants are picked once at runtime and must agree with the scalar ones.
+// AVX2 tails go straight to scalar: calling the legacy-SSE kernel from a
+// 256-bit function costs a state transition that dwarfs short fields.
+bool form_safe(unsigned char c) {
+  return std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~';
+}
 
-  for (unsigned char c : s) {
-    if (std::isalnum(c) || c == '-' || c == '_' || c == '.' || c == '~') {
-      out.push_back((char)c);
-      continue;
+size_t enc_safe_scalar(const char* p, size_t n) {
+  size_t i = 0;
+  while (i < n && form_safe((unsigned char)p[i])) {
+    i++;
+  }
+  return i;
+}
+
+size_t dec_plain_scalar(const char* p, size_t n) {
+  size_t i = 0;
+  while (i < n && p[i] != '%' && p[i] != '+') {
+    i++;
+  }
+  return i;
+}
+
+#if KVS_FORM_SIMD
+__attribute__((target("sse4.2")))
+size_t enc_safe_sse42(const char* p, size_t n) {
+  // Byte ranges that pass through unescaped; cmpestri returns the first byte outside all of them.
+  const __m128i ranges = _mm_setr_epi8('0', '9', 'a', 'z', 'A', 'Z', '-', '-', '_', '_', '.', '.', '~', '~', 0, 0);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    const int k = _mm_cmpestri(ranges, 14, x, 16,
+        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+    if (k < 16) {
+      return i + (size_t)k;
+    }
+  }
+  return i + enc_safe_scalar(p + i, n - i);
+}
+
+__attribute__((target("sse4.2")))
+size_t dec_plain_sse42(const char* p, size_t n) {
+  const __m128i special = _mm_setr_epi8('%', '+', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    const __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+    const int k = _mm_cmpestri(special, 2, x, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+    if (k < 16) {
+      return i + (size_t)k;
+    }
+  }
+  return i + dec_plain_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+size_t enc_safe_avx2(const char* p, size_t n) {
+  // Signed compares: bytes >= 0x80 are negative and fall outside every range.
+  const __m256i digit_lo = _mm256_set1_epi8('0' - 1);
+  const __m256i digit_hi = _mm256_set1_epi8('9' + 1);
+  const __m256i alpha_lo = _mm256_set1_epi8('a' - 1);
+  const __m256i alpha_hi = _mm256_set1_epi8('z' + 1);
+  const __m256i case_bit = _mm256_set1_epi8(0x20);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    const __m256i lower = _mm256_or_si256(x, case_bit);
+    __m256i ok = _mm256_and_si256(_mm256_cmpgt_epi8(x, digit_lo), _mm256_cmpgt_epi8(digit_hi, x));
+    ok = _mm256_or_si256(ok, _mm256_and_si256(_mm256_cmpgt_epi8(lower, alpha_lo), _mm256_cmpgt_epi8(alpha_hi, lower)));
+    ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('-')));
+    ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_')));
+    ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('.')));
+    ok = _mm256_or_si256(ok, _mm256_cmpeq_epi8(x, _mm256_set1_epi8('~')));
+    const uint32_t bad = ~(uint32_t)_mm256_movemask_epi8(ok);
+    if (bad != 0) {
+      return i + (size_t)__builtin_ctz(bad);
+    }
+  }
+  return i + enc_safe_scalar(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+size_t dec_plain_avx2(const char* p, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    const __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+    const __m256i hit = _mm256_or_si256(
+        _mm256_cmpeq_epi8(x, _mm256_set1_epi8('%')),
+        _mm256_cmpeq_epi8(x, _mm256_set1_epi8('+')));
+    const uint32_t mask = (uint32_t)_mm256_movemask_epi8(hit);
+    if (mask != 0) {
+      return i + (size_t)__builtin_ctz(mask);
+    }
+  }
+  return i + dec_plain_scalar(p + i, n - i);
+}
+#endif
+
+struct FormKernels {
+  size_t (*enc_safe)(const char*, size_t);
+  size_t (*dec_plain)(const char*, size_t);
+};
+
+const FormKernels& form_kernels() {
+  static const FormKernels k = []() -> FormKernels {
+#if KVS_FORM_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+      return {enc_safe_avx2, dec_plain_avx2};
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+      return {enc_safe_sse42, dec_plain_sse42};
+    }
+#endif
+    return {enc_safe_scalar, dec_plain_scalar};
+  }();
+  return k;
+}
+
+void enc_append(std::string_view s, std::string* out) {
+  static const char* h = "0123456789ABCDEF";
+  const auto& k = form_kernels();
+  size_t i = 0;
+  while (i < s.size()) {
+    const size_t run = k.enc_safe(s.data() + i, s.size() - i);
+    out->append(s.data() + i, run);
+    i += run;
+    if (i == s.size()) {
+      break;
     }
+    const unsigned char c = (unsigned char)s[i++];
     if (c == ' ') {
-      out.push_back('+');
+      out->push_back('+');
       continue;
     }
-    out.push_back('%');
-    out.push_back(h[(c >> 4) & 15]);
-    out.push_back(h[c & 15]);
+    out->push_back('%');
+    out->push_back(h[(c >> 4) & 15]);
+    out->push_back(h[c & 15]);
   }
-  return out;
 }
 
-std::string dec(const std::string& s) {
-  std::string out;
-  out.reserve(s.size());
+// Exact length enc_append(s) adds, without producing it.
+size_t enc_len(std::string_view s) {
+  const auto& k = form_kernels();
+  size_t n = 0;
+  size_t i = 0;
+  while (i < s.size()) {
+    const size_t run = k.enc_safe(s.data() + i, s.size() - i);
+    n += run;
+    i += run;
+    if (i == s.size()) {
+      break;
+    }
+    n += s[i++] == ' ' ? 1 : 3;
+  }
+  return n;
+}
 
-  for (size_t i = 0; i < s.size(); i++) {
+template <class String>
+void dec_append(std::string_view s, String* out) {
+  const auto& k = form_kernels();
+  size_t i = 0;
+  while (i < s.size()) {
+    const size_t run = k.dec_plain(s.data() + i, s.size() - i);
+    out->append(s.data() + i, run);
+    i += run;
+    if (i == s.size()) {
+      break;
+    }
     if (s[i] == '+') {
-      out.push_back(' ');
+      out->push_back(' ');
+      i++;
       continue;
     }
-    if (s[i] == '%' && i + 2 < s.size()) {
+    if (i + 2 < s.size()) {
       int a = hexv(s[i + 1]);
       int b = hexv(s[i + 2]);
       if (a >= 0 && b >= 0) {
-        out.push_back((char)((a << 4) | b));
-        i += 2;
+        out->push_back((char)((a << 4) | b));
+        i += 3;
         continue;
       }
     }
-    out.push_back(s[i]);
+    out->push_back(s[i++]);
   }
+}
+
+std::string dec(const std::string& s) {
+  std::string out;
+  out.reserve(s.size());
+  dec_append(s, &out);
   return out;
 }
 
@@ -132,94 +705,588 @@ std::map<std::string, std::string> form_parse(const std::string& body) {
   return out;
 }
 
-std::string form_build(const std::vector<std::pair<std::string, std::string>>& kv) {
-  std::ostringstream out;
-  for (size_t i = 0; i < kv.size(); i++) {
-    if (i > 0) {
-      out << '&';
-    }
-    out << enc(kv[i].first) << '=' << enc(kv[i].second);
+// Whole-string integer parse for form values; false on empty or trailing junk.
+bool to_long(std::string_view s, long* out) {
+  long v = 0;
+  const auto r = std::from_chars(s.data(), s.data() + s.size(), v);
+  if (r.ec != std::errc() || r.ptr != s.data() + s.size()) {
+    return false;
   }
-  return out.str();
+  *out = v;
+  return true;
 }
 
-std::vector<NodeInfo> parse_nodes(const std::string& s) {
-  std::vector<NodeInfo> nodes;
-  size_t p = 0;
+size_t dec_digits(size_t v) {
+  size_t n = 1;
+  while (v >= 10) {
+    v /= 10;
+    n++;
+  }
+  return n;
+}
 
-  while (p <= s.size()) {
-    size_t c = s.find(',', p);
-    if (c == std::string::npos) {
-      c = s.size();
-    }
+// Scratch memory for one request, or one fan-out reply parse. The arena lives
+// in a coroutine frame and other requests run on the thread while that frame
+// is suspended, so it owns its buffers: the first 4 KB comes from the heap
+// on first use and grows from there, which keeps a parked request small.
+// Request-scoped containers built on Current() are freed in one go when the
+// arena goes out of scope.
+class RequestArena {
+ public:
+  enum Suspendable { kSuspendable };
+  explicit RequestArena(Suspendable)
+      : saved_(current_), res_(kFrameBytes, std::pmr::new_delete_resource()) {
+    current_ = &res_;
+  }
+  ~RequestArena() { current_ = saved_; }
+  RequestArena(const RequestArena&) = delete;
+  RequestArena& operator=(const RequestArena&) = delete;
 
-    std::string token = tr(s.substr(p, c - p));
-    if (!token.empty()) {
-      size_t at = token.find('@');
-      if (at != std::string::npos && at > 0) {
-        std::string id = tr(token.substr(0, at));
-        std::string hp = tr(token.substr(at + 1));
-        if (hp.rfind("http://", 0) == 0) {
-          hp = hp.substr(7);
-        }
+  static std::pmr::memory_resource* Current() {
+    return current_ ? current_ : std::pmr::get_default_resource();
+  }
 
-        size_t slash = hp.find('/');
-        if (slash != std::string::npos) {
-          hp = hp.substr(0, slash);
-        }
+ private:
+  friend struct RequestContext;
+  static constexpr size_t kFrameBytes = 4 * 1024;
+  static thread_local std::pmr::memory_resource* current_;
+  std::pmr::memory_resource* saved_;
+  std::pmr::monotonic_buffer_resource res_;
+};
 
-        size_t colon = hp.rfind(':');
-        if (!id.empty() && colon != std::string::npos && colon > 0) {
-          NodeInfo n{id, hp.substr(0, colon), 0};
-          try {
-            n.port = std::stoi(hp.substr(colon + 1));
-          } catch (...) {
-            n.port = 0;
-          }
-          if (!n.host.empty() && n.port > 0) {
-            nodes.push_back(n);
-          }
-        }
-      }
-    }
+thread_local std::pmr::memory_resource* RequestArena::current_ = nullptr;
+
+// Absolute deadline (unix ms, 0 = none) of the request this thread works
+// for. Respond opens one from the X-Kvs-Deadline header, coroutines carry it
+// across co_await (RequestContext), and Call()/CallAsync() forward what is left.
+// Replication writes open an empty one (the caller may run them itself) so
+// a late client never leaves a post on fewer replicas.
+class RequestDeadline {
+ public:
+  explicit RequestDeadline(long at_ms) : saved_(current_) { current_ = at_ms; }
+  ~RequestDeadline() { current_ = saved_; }
+  RequestDeadline(const RequestDeadline&) = delete;
+  RequestDeadline& operator=(const RequestDeadline&) = delete;
+
+  static long At() { return current_; }
+  static bool Passed() { return current_ > 0 && now_ms() >= current_; }
+
+ private:
+  friend struct RequestContext;
+  long saved_;
+  static thread_local long current_;
+};
 
-    if (c == s.size()) {
-      break;
-    }
-    p = c + 1;
+thread_local long RequestDeadline::current_ = 0;
+
+// The thread-locals of the request a coroutine works for. Captured when it
+// suspends and reinstalled, on whichever worker resumes it, while it runs.
+struct RequestContext {
+  std::pmr::memory_resource* arena = nullptr;
+  long deadline_ms = 0;
+
+  static RequestContext Capture() { return {RequestArena::current_, RequestDeadline::current_}; }
+  static void Install(const RequestContext& c) {
+    RequestArena::current_ = c.arena;
+    RequestDeadline::current_ = c.deadline_ms;
   }
-  return nodes;
-}
 
-std::string node_key(const NodeInfo& n) {
-  std::ostringstream out;
-  out << n.id << '@' << n.host << ':' << n.port;
-  return out.str();
-}
+  class Scope;
+};
 
-bool read_req(int fd, Engine::Req* r) {
-  std::string data;
-  size_t header_end = std::string::npos;
+// Installs a context for its lifetime and puts the thread's own back after.
+class RequestContext::Scope {
+ public:
+  explicit Scope(const RequestContext& c) : saved_(Capture()) { Install(c); }
+  ~Scope() { Install(saved_); }
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
 
-  while (header_end == std::string::npos) {
-    char buf[4096];
-    ssize_t n = recv(fd, buf, sizeof(buf), 0);
-    if (n <= 0) {
-      return false;
+ private:
+  RequestContext saved_;
+};
+constexpr const char* kDeadlineHeader = "X-Kvs-Deadline";
+constexpr int kClientIoTimeoutMs = 5000;
+
+// Decoded view of a form body for hot paths. Keys and values are decoded into
+// one buffer that Parse() reuses, and fields are views into it, so a parse
+// costs no per-field allocation. Keys ending in a decimal index ("title12")
+// are also filed under their base name: At("title", 12) is an array lookup
+// instead of a scan for "title" + std::to_string(12).
+class FormView {
+ public:
+  explicit FormView(std::pmr::memory_resource* mr = RequestArena::Current())
+      : buf_(mr), fields_(mr), lists_(mr) {}
+
+  void Parse(std::string_view body) {
+    buf_.clear();
+    // Decoding never grows the input, so views into buf_ stay valid.
+    buf_.reserve(body.size());
+    fields_.clear();
+    for (size_t i = 0; i < lists_used_; i++) {
+      lists_[i].values.clear();
     }
-    data.append(buf, n);
-    header_end = data.find("\r\n\r\n");
-    if (data.size() > 1024 * 1024) {
-      return false;
+    lists_used_ = 0;
+    slots_ = 0;
+
+    size_t p = 0;
+    while (p < body.size()) {
+      size_t a = body.find('&', p);
+      if (a == std::string_view::npos) {
+        a = body.size();
+      }
+      const std::string_view t = body.substr(p, a - p);
+      if (!t.empty()) {
+        const size_t e = t.find('=');
+        const std::string_view key = Decode(t.substr(0, e));
+        const std::string_view value = e == std::string_view::npos ? std::string_view() : Decode(t.substr(e + 1));
+        fields_.emplace_back(key, value);
+        Index(key, value);
+      }
+      p = a + 1;
     }
   }
 
-  std::istringstream hs(data.substr(0, header_end));
-  std::string line;
-  if (!std::getline(hs, line)) {
-    return false;
-  }
-  if (!line.empty() && line.back() == '\r') {
+  // Last occurrence wins, like form_parse(); "" when missing.
+  std::string_view Get(std::string_view key) const {
+    for (size_t i = fields_.size(); i > 0; i--) {
+      if (fields_[i - 1].first == key) {
+        return fields_[i - 1].second;
+      }
+    }
+    return {};
+  }
+
+  std::string_view At(std::string_view base, size_t i) const {
+    const List* l = Find(base);
+    return l && i < l->values.size() ? l->values[i] : std::string_view();
+  }
+
+  size_t Size(std::string_view base) const {
+    const List* l = Find(base);
+    return l ? l->values.size() : 0;
+  }
+
+ private:
+  // Indexed slots across all lists stay within a small multiple of the fields
+  // seen so far, so sparse keys (a1=..&b65535=..) cannot force huge arrays.
+  // Keys past the budget are treated as plain keys.
+  static constexpr size_t kSlotSlack = 64;
+  struct List {
+    explicit List(std::pmr::memory_resource* mr) : values(mr) {}
+    std::string_view base;
+    std::pmr::vector<std::string_view> values;
+  };
+
+  std::string_view Decode(std::string_view s) {
+    const size_t start = buf_.size();
+    dec_append(s, &buf_);
+    return std::string_view(buf_.data() + start, buf_.size() - start);
+  }
+
+  void Index(std::string_view key, std::string_view value) {
+    size_t d = key.size();
+    while (d > 0 && key[d - 1] >= '0' && key[d - 1] <= '9') {
+      d--;
+    }
+    if (d == 0 || d == key.size() || key.size() - d > 5) {
+      return;
+    }
+    size_t i = 0;
+    for (size_t j = d; j < key.size(); j++) {
+      i = i * 10 + (size_t)(key[j] - '0');
+    }
+    const std::string_view base = key.substr(0, d);
+    List* l = const_cast<List*>(Find(base));
+    const size_t have = l ? l->values.size() : 0;
+    const size_t grow = i < have ? 0 : i + 1 - have;
+    if (slots_ + grow > 2 * fields_.size() + kSlotSlack) {
+      return;
+    }
+    if (!l) {
+      if (lists_used_ == lists_.size()) {
+        lists_.emplace_back(lists_.get_allocator().resource());
+      }
+      l = &lists_[lists_used_++];
+      l->base = base;
+    }
+    if (grow > 0) {
+      l->values.resize(i + 1);
+      slots_ += grow;
+    }
+    l->values[i] = value;
+  }
+
+  const List* Find(std::string_view base) const {
+    for (size_t i = 0; i < lists_used_; i++) {
+      if (lists_[i].base == base) {
+        return &lists_[i];
+      }
+    }
+    return nullptr;
+  }
+
+  std::pmr::string buf_;
+  std::pmr::vector<std::pair<std::string_view, std::string_view>> fields_;
+  std::pmr::vector<List> lists_;
+  size_t lists_used_ = 0;
+  size_t slots_ = 0;
+};
+
+// Appends fields to one buffer. Callers that know every field up front size
+// it with FieldLen() so the body is written without reallocating.
+class FormWriter {
+ public:
+  explicit FormWriter(size_t size) { out_.reserve(size); }
+
+  static size_t FieldLen(std::string_view key, std::string_view value) {
+    return enc_len(key) + 1 + enc_len(value) + 1;
+  }
+
+  void Add(std::string_view key, std::string_view value) {
+    Sep();
+    enc_append(key, &out_);
+    out_.push_back('=');
+    enc_append(value, &out_);
+  }
+
+  // key + decimal index; key must not need escaping.
+  void Add(std::string_view key, size_t index, std::string_view value) {
+    Sep();
+    out_.append(key.data(), key.size());
+    char digits[24];
+    const auto r = std::to_chars(digits, digits + sizeof(digits), index);
+    out_.append(digits, (size_t)(r.ptr - digits));
+    out_.push_back('=');
+    enc_append(value, &out_);
+  }
+
+  void Add(std::string_view key, size_t index, long value) {
+    char digits[24];
+    const auto r = std::to_chars(digits, digits + sizeof(digits), value);
+    Add(key, index, std::string_view(digits, (size_t)(r.ptr - digits)));
+  }
+
+  std::string Take() { return std::move(out_); }
+
+ private:
+  void Sep() {
+    if (!out_.empty()) {
+      out_.push_back('&');
+    }
+  }
+
+  std::string out_;
+};
+
+std::string form_build(const std::vector<std::pair<std::string, std::string>>& kv) {
+  size_t size = 0;
+  for (const auto& f : kv) {
+    size += FormWriter::FieldLen(f.first, f.second);
+  }
+  FormWriter w(size);
+  for (const auto& f : kv) {
+    w.Add(f.first, f.second);
+  }
+  return w.Take();
+}
+
+// List responses (/post/titles, by_account, search and their internal
+// variants) share one shape: head fields, then idN/account_idN/titleN/created_atN.
+template <class Rows>
+std::string post_list_form(const std::vector<std::pair<std::string, std::string>>& head, const Rows& items) {
+  static constexpr std::string_view kKeys = "idaccount_idtitlecreated_at";
+  size_t size = 0;
+  for (const auto& f : head) {
+    size += FormWriter::FieldLen(f.first, f.second);
+  }
+  for (size_t i = 0; i < items.size(); i++) {
+    const long created_at = items[i].created_at;
+    size += kKeys.size() + 4 * (dec_digits(i) + 2) +
+        enc_len(items[i].id) + enc_len(items[i].account_id) + enc_len(items[i].title) +
+        (created_at < 0 ? 1 + dec_digits((size_t)-created_at) : dec_digits((size_t)created_at));
+  }
+
+  FormWriter w(size);
+  for (const auto& f : head) {
+    w.Add(f.first, f.second);
+  }
+  for (size_t i = 0; i < items.size(); i++) {
+    w.Add("id", i, items[i].id);
+    w.Add("account_id", i, items[i].account_id);
+    w.Add("title", i, items[i].title);
+    w.Add("created_at", i, items[i].created_at);
+  }
+  return w.Take();
+}
+
+// "limit" request field: at least 1, def when missing or not a number.
+int form_limit(const FormView& in, int def) {
+  long limit = 0;
+  if (!to_long(in.Get("limit"), &limit)) {
+    return def;
+  }
+  return (int)std::max(1L, std::min<long>(limit, std::numeric_limits<int>::max()));
+}
+
+// Keeps the newest copy of every id (replicas can lag each other), then
+// orders newest first and cuts to limit (<= 0: no cut). Works in place, so
+// rows never leave the arena they were built in.
+template <class Rows>
+void finish_rows(Rows* rows, int limit) {
+  using Row = typename Rows::value_type;
+  std::sort(rows->begin(), rows->end(), [](const Row& a, const Row& b) {
+    if (a.id != b.id) {
+      return a.id < b.id;
+    }
+    return a.created_at > b.created_at;
+  });
+  rows->erase(std::unique(rows->begin(), rows->end(), [](const Row& a, const Row& b) { return a.id == b.id; }), rows->end());
+  std::sort(rows->begin(), rows->end(), [](const Row& a, const Row& b) {
+    if (a.created_at == b.created_at) {
+      return a.id > b.id;
+    }
+    return a.created_at > b.created_at;
+  });
+  if (limit > 0 && rows->size() > (size_t)limit) {
+    rows->erase(rows->begin() + limit, rows->end());
+  }
+}
+
+// Reads a list response written by post_list_form(); false unless ok=1.
+template <class Rows>
+bool read_post_list(const FormView& f, Rows* out) {
+  if (f.Get("ok") != "1") {
+    return false;
+  }
+  long count = 0;
+  to_long(f.Get("count"), &count);
+  const size_t n = std::min((size_t)std::max(0L, count), f.Size("id"));
+  out->reserve(out->size() + n);
+  for (size_t i = 0; i < n; i++) {
+    const std::string_view id = f.At("id", i);
+    if (id.empty()) {
+      continue;
+    }
+    auto& p = out->emplace_back();
+    p.id.assign(id);
+    p.account_id.assign(f.At("account_id", i));
+    p.title.assign(f.At("title", i));
+    if (!to_long(f.At("created_at", i), &p.created_at)) {
+      p.created_at = 0;
+    }
+  }
+  return true;
+}
+
+// Columnar list body, sent instead of post_list_form() when the request has
+// format=columnar (/post/titles, /internal/post/titles). Little-endian:
+//   "KVC1" | u32 count | u32 flags (1 = degraded) | u32 offset[4] | u32 size
+// then one column per offset: id, account_id, title as count u32 lengths
+// followed by the bytes, created_at as count i64. Error replies stay form.
+constexpr std::string_view kColumnarMagic = "KVC1";
+constexpr const char* kColumnarType = "application/x-kvs-columns";
+constexpr size_t kColumnarHeader = 4 + 4 * 7;
+constexpr uint32_t kColumnarDegraded = 1;
+
+bool wants_columnar(const FormView& in) {
+  return in.Get("format") == "columnar";
+}
+
+void put_u32(char* p, uint32_t v) {
+  for (int i = 0; i < 4; i++) {
+    p[i] = (char)(v >> (8 * i));
+  }
+}
+
+uint32_t get_u32(const char* p) {
+  uint32_t v = 0;
+  for (int i = 0; i < 4; i++) {
+    v |= (uint32_t)(unsigned char)p[i] << (8 * i);
+  }
+  return v;
+}
+
+template <class Rows>
+std::string post_list_columns(const Rows& items, bool degraded) {
+  const size_t n = items.size();
+  size_t text[3] = {0, 0, 0};
+  for (const auto& p : items) {
+    text[0] += p.id.size();
+    text[1] += p.account_id.size();
+    text[2] += p.title.size();
+  }
+  uint32_t off[4];
+  size_t size = kColumnarHeader;
+  for (int c = 0; c < 3; c++) {
+    off[c] = (uint32_t)size;
+    size += 4 * n + text[c];
+  }
+  off[3] = (uint32_t)size;
+  size += 8 * n;
+
+  std::string out(size, '\0');
+  char* h = out.data();
+  std::memcpy(h, kColumnarMagic.data(), kColumnarMagic.size());
+  put_u32(h + 4, (uint32_t)n);
+  put_u32(h + 8, degraded ? kColumnarDegraded : 0);
+  for (int c = 0; c < 4; c++) {
+    put_u32(h + 12 + 4 * c, off[c]);
+  }
+  put_u32(h + 28, (uint32_t)size);
+
+  auto column = [&](int c, auto field) {
+    char* len = h + off[c];
+    char* bytes = len + 4 * n;
+    for (const auto& p : items) {
+      const auto& s = field(p);
+      put_u32(len, (uint32_t)s.size());
+      len += 4;
+      std::memcpy(bytes, s.data(), s.size());
+      bytes += s.size();
+    }
+  };
+  column(0, [](const auto& p) -> const auto& { return p.id; });
+  column(1, [](const auto& p) -> const auto& { return p.account_id; });
+  column(2, [](const auto& p) -> const auto& { return p.title; });
+  char* ts = h + off[3];
+  for (const auto& p : items) {
+    const uint64_t v = (uint64_t)(int64_t)p.created_at;
+    put_u32(ts, (uint32_t)v);
+    put_u32(ts + 4, (uint32_t)(v >> 32));
+    ts += 8;
+  }
+  return out;
+}
+
+// Reads a post_list_columns() body. Every length is checked against the
+// body, so a short or corrupt reply is rejected rather than half-read.
+template <class Rows>
+bool read_post_columns(std::string_view b, Rows* out, bool* degraded = nullptr) {
+  if (b.size() < kColumnarHeader || b.substr(0, 4) != kColumnarMagic || get_u32(b.data() + 28) != b.size()) {
+    return false;
+  }
+  const size_t n = get_u32(b.data() + 4);
+  size_t off[4];
+  for (int c = 0; c < 4; c++) {
+    off[c] = get_u32(b.data() + 12 + 4 * c);
+  }
+  if (off[0] < kColumnarHeader || off[0] > off[1] || off[1] > off[2] || off[2] > off[3] || off[3] > b.size() ||
+      (b.size() - off[3]) / 8 < n) {
+    return false;
+  }
+  // Lengths first: validates all three text columns before touching out.
+  for (int c = 0; c < 3; c++) {
+    const size_t limit = off[c + 1];
+    if ((limit - off[c]) / 4 < n) {
+      return false;
+    }
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+      total += get_u32(b.data() + off[c] + 4 * i);
+    }
+    if (total > limit - off[c] - 4 * n) {
+      return false;
+    }
+  }
+
+  const size_t first = out->size();
+  out->resize(first + n);
+  auto column = [&](int c, auto field) {
+    const char* len = b.data() + off[c];
+    const char* bytes = len + 4 * n;
+    for (size_t i = 0; i < n; i++) {
+      const uint32_t l = get_u32(len + 4 * i);
+      field((*out)[first + i]).assign(bytes, l);
+      bytes += l;
+    }
+  };
+  column(0, [](auto& p) -> auto& { return p.id; });
+  column(1, [](auto& p) -> auto& { return p.account_id; });
+  column(2, [](auto& p) -> auto& { return p.title; });
+  const char* ts = b.data() + off[3];
+  for (size_t i = 0; i < n; i++, ts += 8) {
+    const uint64_t v = (uint64_t)get_u32(ts) | (uint64_t)get_u32(ts + 4) << 32;
+    (*out)[first + i].created_at = (long)(int64_t)v;
+  }
+  out->erase(std::remove_if(out->begin() + first, out->end(), [](const auto& p) { return p.id.empty(); }), out->end());
+  if (degraded) {
+    *degraded = (get_u32(b.data() + 8) & kColumnarDegraded) != 0;
+  }
+  return true;
+}
+
+std::vector<NodeInfo> parse_nodes(const std::string& s) {
+  std::vector<NodeInfo> nodes;
+  size_t p = 0;
+
+  while (p <= s.size()) {
+    size_t c = s.find(',', p);
+    if (c == std::string::npos) {
+      c = s.size();
+    }
+
+    std::string token = tr(s.substr(p, c - p));
+    if (!token.empty()) {
+      size_t at = token.find('@');
+      if (at != std::string::npos && at > 0) {
+        std::string id = tr(token.substr(0, at));
+        std::string hp = tr(token.substr(at + 1));
+        if (hp.rfind("http://", 0) == 0) {
+          hp = hp.substr(7);
+        }
+
+        size_t slash = hp.find('/');
+        if (slash != std::string::npos) {
+          hp = hp.substr(0, slash);
+        }
+
+        size_t colon = hp.rfind(':');
+        if (!id.empty() && colon != std::string::npos && colon > 0) {
+          NodeInfo n{id, hp.substr(0, colon), 0};
+          try {
+            n.port = std::stoi(hp.substr(colon + 1));
+          } catch (...) {
+            n.port = 0;
+          }
+          if (!n.host.empty() && n.port > 0) {
+            nodes.push_back(n);
+          }
+        }
+      }
+    }
+
+    if (c == s.size()) {
+      break;
+    }
+    p = c + 1;
+  }
+  return nodes;
+}
+
+bool read_req(int fd, Engine::Req* r) {
+  std::string data;
+  size_t header_end = std::string::npos;
+
+  while (header_end == std::string::npos) {
+    char buf[4096];
+    ssize_t n = recv(fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+      return false;
+    }
+    data.append(buf, n);
+    header_end = data.find("\r\n\r\n");
+    if (data.size() > 1024 * 1024) {
+      return false;
+    }
+  }
+
+  std::istringstream hs(data.substr(0, header_end));
+  std::string line;
+  if (!std::getline(hs, line)) {
+    return false;
+  }
+  if (!line.empty() && line.back() == '\r') {
     line.pop_back();
   }
 
@@ -242,6 +1309,10 @@ bool read_req(int fd, Engine::Req* r) {
     for (char& ch : key) {
       ch = (char)std::tolower((unsigned char)ch);
     }
+    if (key == "x-kvs-deadline") {
+      to_long(tr(line.substr(c + 1)), &r->deadline_ms);
+      continue;
+    }
     if (key == "content-length") {
       try {
         content_length = (size_t)std::stoul(tr(line.substr(c + 1)));
@@ -272,7 +1343,7 @@ bool read_req(int fd, Engine::Req* r) {
 void send_resp(int fd, const Engine::Resp& r) {
   std::ostringstream out;
   out << "HTTP/1.1 " << r.status << " OK\r\n"
-      << "Content-Type: application/x-www-form-urlencoded\r\n"
+      << "Content-Type: " << (r.content_type.empty() ? "application/x-www-form-urlencoded" : r.content_type) << "\r\n"
       << "Content-Length: " << r.body.size() << "\r\n"
       << "Connection: close\r\n\r\n"
       << r.body;
@@ -293,7 +1364,47 @@ struct CRes {
   std::string b;
 };
 
-CRes post(const std::string& host, int port, const std::string& path, const std::string& body, int timeout_ms) {
+std::string request_wire(const std::string& host, int port, const std::string& path, const std::string& body, long deadline_ms) {
+  std::ostringstream req;
+  req << "POST " << path << " HTTP/1.1\r\n"
+      << "Host: " << host << ':' << port << "\r\n"
+      << "Content-Type: application/x-www-form-urlencoded\r\n"
+      << "Content-Length: " << body.size() << "\r\n";
+  if (deadline_ms > 0) {
+    req << kDeadlineHeader << ": " << deadline_ms << "\r\n";
+  }
+  req << "Connection: close\r\n\r\n"
+      << body;
+  return req.str();
+}
+
+CRes parse_reply(const std::string& data) {
+  CRes r;
+  size_t header_end = data.find("\r\n\r\n");
+  if (header_end == std::string::npos) {
+    return r;
+  }
+
+  std::istringstream hs(data.substr(0, header_end));
+  std::string status_line;
+  if (!std::getline(hs, status_line)) {
+    return r;
+  }
+  if (!status_line.empty() && status_line.back() == '\r') {
+    status_line.pop_back();
+  }
+
+  std::istringstream ss(status_line);
+  std::string http_v;
+  ss >> http_v >> r.s;
+  r.b = data.substr(header_end + 4);
+  return r;
+}
+
+CRes post(const std::string& host, int port, const std::string& path, const std::string& body, int timeout_ms,
+          long deadline_ms = 0, CallCancel* cancel = nullptr) {
+  // Name lookup, connect and the peer's reply all block this worker.
+  Executor::Blocking blocking;
   CRes r;
 
   addrinfo hint{};
@@ -318,9 +1429,18 @@ CRes post(const std::string& host, int port, const std::string& path, const std:
     setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
     setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
 
-    if (connect(fd, x->ai_addr, x->ai_addrlen) == 0) {
+    // Attached before connect so a cancel also aborts a peer stuck in the handshake.
+    if (cancel && !cancel->Attach(fd)) {
+      close(fd);
+      fd = -1;
+      break;
+    }
+    if (connect(fd, x->ai_addr, x->ai_addrlen) == 0 && !(cancel && cancel->Cancelled())) {
       break;
     }
+    if (cancel) {
+      cancel->Detach();
+    }
     close(fd);
     fd = -1;
   }
@@ -329,20 +1449,18 @@ CRes post(const std::string& host, int port, const std::string& path, const std:
   if (fd < 0) {
     return r;
   }
+  auto drop = [&]() {
+    if (cancel) {
+      cancel->Detach();
+    }
+    close(fd);
+  };
 
-  std::ostringstream req;
-  req << "POST " << path << " HTTP/1.1\r\n"
-      << "Host: " << host << ':' << port << "\r\n"
-      << "Content-Type: application/x-www-form-urlencoded\r\n"
-      << "Content-Length: " << body.size() << "\r\n"
-      << "Connection: close\r\n\r\n"
-      << body;
-
-  std::string wire = req.str();
+  const std::string wire = request_wire(host, port, path, body, deadline_ms);
   for (size_t off = 0; off < wire.size();) {
     ssize_t n = send(fd, wire.data() + off, wire.size() - off, 0);
     if (n <= 0) {
-      close(fd);
+      drop();
       return r;
     }
     off += (size_t)n;
@@ -354,618 +1472,3415 @@ CRes post(const std::string& host, int port, const std::string& path, const std:
   while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
     data.append(buf, n);
   }
-  close(fd);
-
-  size_t header_end = data.find("\r\n\r\n");
-  if (header_end == std::string::npos) {
+  drop();
+  // A shutdown() mid-reply looks like a clean EOF; never hand back a cut-off body.
+  if (cancel && cancel->Cancelled()) {
     return r;
   }
+  return parse_reply(data);
+}
 
-  std::istringstream hs(data.substr(0, header_end));
-  std::string status_line;
-  if (!std::getline(hs, status_line)) {
-    return r;
-  }
-  if (!status_line.empty() && status_line.back() == '\r') {
-    status_line.pop_back();
+// Generated post ids: 42-bit unix ms | 10-bit node slot | 11-bit sequence
+// (Engine::NewPostId), written as 13 fixed-width lowercase Crockford base32
+// digits. The alphabet is in ASCII order, so string order is numeric order,
+// and current ids start with '2'/'3', after the older "<ms>-<8 hex>" form.
+constexpr int kIdSeqBits = 11;
+constexpr int kIdNodeBits = 10;
+// The last slot belongs to `kvsd bulk-load`, which makes up ids for posts
+// without one while the daemons keep issuing their own.
+constexpr uint32_t kBulkLoadIdNode = (1u << kIdNodeBits) - 1;
+constexpr size_t kIdLen = 13;
+constexpr std::string_view kIdDigits = "0123456789abcdefghjkmnpqrstvwxyz";
+
+std::string post_id_text(uint64_t v) {
+  std::string out(kIdLen, '0');
+  for (size_t i = kIdLen; i-- > 0; v >>= 5) {
+    out[i] = kIdDigits[v & 31];
   }
+  return out;
+}
 
-  std::istringstream ss(status_line);
-  std::string http_v;
-  ss >> http_v >> r.s;
-  r.b = data.substr(header_end + 4);
-  return r;
-}
-
-std::string pid_new() {
-  static thread_local std::mt19937_64 g(std::random_device{}());
-  static const char* h = "0123456789abcdef";
-  std::string x;
-  for (int i = 0; i < 8; i++) {
-    x.push_back(h[g() & 15]);
+// Inverse of post_id_text(); false for anything it would not have written.
+bool post_id_value(std::string_view s, uint64_t* out) {
+  if (s.size() != kIdLen) {
+    return false;
   }
-  return std::to_string(now_ms()) + "-" + x;
-}
-
-std::string title_index_key(long created_at, const std::string& id) {
-  static constexpr long kMaxTs = 9999999999999L;
-  long ts = created_at;
-  if (ts < 0) {
-    ts = 0;
-  } else if (ts > kMaxTs) {
-    ts = kMaxTs;
+  uint64_t v = 0;
+  for (size_t i = 0; i < kIdLen; i++) {
+    const size_t d = kIdDigits.find(s[i]);
+    if (d == std::string_view::npos || (i == 0 && d > 7)) {
+      return false;
+    }
+    v = v << 5 | d;
   }
-  const long rev = kMaxTs - ts;
-  std::ostringstream out;
-  out << "t:" << std::setw(13) << std::setfill('0') << rev << ':' << id;
-  return out.str();
+  *out = v;
+  return true;
 }
 
-}  // namespace
+const char* kIndexBackfillKey = "meta:index_backfill";
+// Bump when the builder starts covering a new index so finished nodes run it again.
+const char* kIndexBackfillDone = "done:4";
+const char* kSearchNextDocKey = "meta:next_doc";
+// Default CF: generated ids never reuse an ms at or below this, across restarts.
+const char* kIdLeaseKey = "meta:id_lease";
+// How far past the current id ms one lease write reaches.
+constexpr uint64_t kIdLeaseMs = 1000;
+// Default CF, one row per bulk ingest whose stale-row deletes failed after its
+// files went in; Engine::RepairStaleRows() finishes them.
+const char* kStaleRowsPrefix = "meta:stale:";
+constexpr size_t kCheckpointChunkBytes = 4 * 1024 * 1024;
+constexpr size_t kBulkLinesPerCall = 20000;
+constexpr int kBulkCallTimeoutMs = 120000;
+
+// One sorted SST worth of rows for a column family; later rows win.
+struct SstRows {
+  enum Op { kPut, kMerge, kDelete };
+  std::map<std::string, std::pair<Op, std::string>> rows;
+  void Put(const std::string& k, std::string v) { rows[k] = {kPut, std::move(v)}; }
+  void Delete(const std::string& k) { rows[k] = {kDelete, std::string()}; }
+  void Merge(const std::string& k, std::string v) { rows[k] = {kMerge, std::move(v)}; }
+};
 
-Engine::Engine(Config cfg)
-    : cfg_(std::move(cfg)), nodes_(parse_nodes(cfg_.cluster_nodes)) {
-  if (cfg_.single_node) {
-    nodes_.clear();
-    nodes_.push_back({cfg_.node_id, "127.0.0.1", cfg_.port});
-    return;
+// Writes rows to `path` as one SST for `cf`; an empty set writes nothing.
+bool write_sst(rocksdb::DB* db, rocksdb::ColumnFamilyHandle* cf, const SstRows& rows, const std::string& path) {
+  if (rows.rows.empty()) {
+    return true;
   }
-  bool self = false;
-  for (const auto& n : nodes_) {
-    if (n.id == cfg_.node_id) {
-      self = true;
-      break;
-    }
+  rocksdb::SstFileWriter writer(rocksdb::EnvOptions(), db->GetOptions(cf), cf);
+  if (!writer.Open(path).ok()) {
+    return false;
   }
-  if (!self) {
-    nodes_.push_back({cfg_.node_id, "127.0.0.1", cfg_.port});
+  for (const auto& kv : rows.rows) {
+    rocksdb::Status st;
+    if (kv.second.first == SstRows::kPut) {
+      st = writer.Put(kv.first, kv.second.second);
+    } else if (kv.second.first == SstRows::kMerge) {
+      st = writer.Merge(kv.first, kv.second.second);
+    } else {
+      st = writer.Delete(kv.first);
+    }
+    if (!st.ok()) {
+      return false;
+    }
   }
+  return writer.Finish().ok();
 }
 
-Engine::~Engine() {
-  Stop();
-}
+// A file write_sst() wrote for `rows` into `cf`.
+struct SstFile {
+  rocksdb::ColumnFamilyHandle* cf;
+  const SstRows* rows;
+  std::string path;
+};
 
-bool Engine::InitDb() {
-  std::error_code ec;
-  std::filesystem::create_directories(cfg_.db_path, ec);
-  if (ec) {
-    return false;
+// Moves the files into the DB in one IngestExternalFiles() call, which RocksDB
+// applies atomically across column families: every CF shows the load or none
+// does. Empty row sets wrote no file and are skipped.
+bool ingest_ssts(rocksdb::DB* db, const std::vector<SstFile>& files) {
+  std::vector<rocksdb::IngestExternalFileArg> args;
+  for (const auto& f : files) {
+    if (f.rows->rows.empty()) {
+      continue;
+    }
+    rocksdb::IngestExternalFileArg a;
+    a.column_family = f.cf;
+    a.external_files = {f.path};
+    a.options.move_files = true;
+    args.push_back(std::move(a));
   }
+  return args.empty() || db->IngestExternalFiles(args).ok();
+}
 
-  std::vector<std::string> names;
-  if (std::filesystem::exists(cfg_.db_path + "/CURRENT")) {
-    rocksdb::Options o;
-    if (!rocksdb::DB::ListColumnFamilies(o, cfg_.db_path, &names).ok()) {
-      return false;
-    }
+// Routes a warming node turns away: public traffic and node-to-node reads, so
+// callers fall back to another replica. Replication writes and ping stay open.
+bool refused_while_warming(const std::string& path) {
+  if (path.rfind("/internal/", 0) != 0) {
+    return true;
   }
+  return path == "/internal/account/get" ||
+      path == "/internal/post/get" ||
+      path == "/internal/post/titles" ||
+      path == "/internal/post/by_account" ||
+      path == "/internal/post/search";
+}
 
-  auto add = [&](const std::string& n) {
-    if (std::find(names.begin(), names.end(), n) == names.end()) {
-      names.push_back(n);
+// Routes under an adaptive concurrency limit and the scheduler, one limiter
+// each, with the request class that picks their queue. Ping, stats and admin
+// routes skip both so liveness and operators still get through.
+struct LimitedRoute {
+  const char* path;
+  RequestClass cls;
+};
+constexpr LimitedRoute kLimitedRoutes[] = {
+    {"/account/create", kClassPublicWrite},
+    {"/account/get", kClassPublicRead},
+    {"/post/create", kClassPublicWrite},
+    {"/post/get", kClassPublicRead},
+    {"/post/titles", kClassPublicRead},
+    {"/post/by_account", kClassPublicRead},
+    {"/post/search", kClassPublicRead},
+    {"/internal/account/put", kClassInternalWrite},
+    {"/internal/account/get", kClassInternalRead},
+    {"/internal/post/put", kClassInternalWrite},
+    {"/internal/post/get", kClassInternalRead},
+    {"/internal/post/titles", kClassInternalRead},
+    {"/internal/post/by_account", kClassInternalRead},
+    {"/internal/post/search", kClassInternalRead},
+    {"/internal/account/holders", kClassInternalWrite},
+};
+constexpr int kLimitedRouteCount = (int)(sizeof(kLimitedRoutes) / sizeof(kLimitedRoutes[0]));
+
+// Gradient limiter tuning: the limit never drops below kMinRouteLimit, short
+// latency may run kLimitTolerance x the long-run average before it shrinks.
+constexpr int kMinRouteLimit = 8;
+constexpr double kLimitTolerance = 1.5;
+constexpr double kShortRttSamples = 10;
+constexpr double kLongRttSamples = 500;
+
+// Scheduler weights, indexed by RequestClass.
+constexpr int kClassWeight[kRequestClasses] = {8, 4, 2, 1};
+constexpr const char* kClassName[kRequestClasses] = {"internal_write", "public_write", "internal_read", "public_read"};
+
+int limited_route(const std::string& path) {
+  for (int i = 0; i < kLimitedRouteCount; i++) {
+    if (path == kLimitedRoutes[i].path) {
+      return i;
     }
-  };
-  add(rocksdb::kDefaultColumnFamilyName);
-  add("account");
-  add("post");
-
-  std::vector<rocksdb::ColumnFamilyDescriptor> desc;
-  for (const auto& n : names) {
-    desc.emplace_back(n, rocksdb::ColumnFamilyOptions());
   }
+  return -1;
+}
 
-  rocksdb::DBOptions o;
-  o.create_if_missing = true;
-  o.create_missing_column_families = true;
-
-  rocksdb::DB* db = nullptr;
-  std::vector<rocksdb::ColumnFamilyHandle*> handles;
-  if (!rocksdb::DB::Open(o, cfg_.db_path, desc, &handles, &db).ok()) {
+// Checkpoint ids are timestamps and file names come straight from the
+// checkpoint directory; anything else is rejected before touching the disk.
+bool checkpoint_name_ok(const std::string& s) {
+  if (s.empty() || s == "." || s == "..") {
     return false;
   }
-
-  db_ = db;
-  for (size_t i = 0; i < names.size(); i++) {
-    cfs_.push_back(handles[i]);
-    if (names[i] == rocksdb::kDefaultColumnFamilyName) {
-      def_cf_ = handles[i];
-    } else if (names[i] == "account") {
-      acc_cf_ = handles[i];
-    } else if (names[i] == "post") {
-      post_cf_ = handles[i];
+  for (unsigned char c : s) {
+    if (!std::isalnum(c) && c != '.' && c != '-' && c != '_') {
+      return false;
     }
   }
-
-  return def_cf_ && acc_cf_ && post_cf_;
+  return true;
 }
 
-void Engine::CloseDb() {
-  for (void* h : cfs_) {
-    delete static_cast<rocksdb::ColumnFamilyHandle*>(h);
+rocksdb::CompressionType compression_type(std::string s) {
+  for (char& c : s) {
+    c = (char)std::tolower((unsigned char)c);
   }
-  cfs_.clear();
-  def_cf_ = nullptr;
-  acc_cf_ = nullptr;
-  post_cf_ = nullptr;
+  if (s == "none" || s == "no") return rocksdb::kNoCompression;
+  if (s == "snappy") return rocksdb::kSnappyCompression;
+  if (s == "lz4") return rocksdb::kLZ4Compression;
+  if (s == "zlib") return rocksdb::kZlibCompression;
+  return rocksdb::kZSTD;
+}
 
-  if (db_) {
-    delete static_cast<rocksdb::DB*>(db_);
-    db_ = nullptr;
-  }
+// "<reverse_created_at>:<post_id>" for the u: index and by_account cursors, so both sort newest first.
+std::string rev_ts_id(long created_at, const std::string& id) {
+  static constexpr long kMaxTs = 9999999999999L;
+  const long rev = kMaxTs - std::max(0L, std::min(created_at, kMaxTs));
+  char digits[24];
+  const auto r = std::to_chars(digits, digits + sizeof(digits), rev);
+  const size_t len = (size_t)(r.ptr - digits);
+  std::string out;
+  out.reserve(13 + 1 + id.size());
+  out.append(13 - std::min<size_t>(len, 13), '0');
+  out.append(digits, len);
+  out.push_back(':');
+  out.append(id);
+  return out;
 }
 
-bool Engine::Start() {
-  if (!InitDb()) {
-    return false;
+void put_be(std::string* out, uint64_t v, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) {
+    out->push_back((char)(v >> (8 * i)));
   }
-  std::cout << "[kvs] node=" << cfg_.node_id
-            << " listen=0.0.0.0:" << cfg_.port
-            << " db_path=" << cfg_.db_path
-            << " single_node=" << (cfg_.single_node ? "true" : "false")
-            << " cluster_nodes=" << cfg_.cluster_nodes
-            << std::endl;
-  stop_ = false;
-  th_ = std::thread(&Engine::Serve, this);
-  return true;
 }
 
-void Engine::Stop() {
-  if (stop_) {
-    return;
+// t: keys are "t:" + big-endian ~created_at + encoded id, so a bytewise
+// comparator yields newest first. created_at is clamped at 0 like the text
+// form, which keeps the first byte >= 0x80 and apart from the old
+// "t:<13 digits>:<id>" keys (see kLegacyTitleBegin). Generated ids pack into
+// fixed widths: 8 bytes (~value, newest first within a ms) for current ids,
+// 12 for the older "<ms>-<8 hex>" form. Anything else is stored as-is behind
+// its own tag.
+constexpr char kTitleIdPacked = 0x01;
+constexpr char kTitleIdRaw = 0x02;
+constexpr char kTitleIdSnowflake = 0x03;
+constexpr size_t kTitleIdPackedLen = 1 + 8 + 4;
+
+bool pack_post_id(const std::string& id, uint64_t* ms, uint32_t* rnd) {
+  const size_t dash = id.find('-');
+  if (dash == std::string::npos || dash == 0 || dash > 19 || id.size() != dash + 9 || (id[0] == '0' && dash > 1)) {
+    return false;
   }
-  stop_ = true;
-  if (listen_fd_ >= 0) {
-    close(listen_fd_);
-    listen_fd_ = -1;
+  const char* b = id.data();
+  auto r = std::from_chars(b, b + dash, *ms);
+  if (r.ec != std::errc() || r.ptr != b + dash) {
+    return false;
   }
-  if (th_.joinable()) {
-    th_.join();
+  uint32_t v = 0;
+  for (size_t i = dash + 1; i < id.size(); i++) {
+    const char c = id[i];
+    if (c >= '0' && c <= '9') {
+      v = v << 4 | (uint32_t)(c - '0');
+    } else if (c >= 'a' && c <= 'f') {
+      v = v << 4 | (uint32_t)(c - 'a' + 10);
+    } else {
+      return false;
+    }
   }
-  CloseDb();
+  *rnd = v;
+  return true;
 }
 
-void Engine::Serve() {
-  int fd = socket(AF_INET, SOCK_STREAM, 0);
-  if (fd < 0) {
-    return;
+std::string title_index_key(long created_at, const std::string& id) {
+  uint64_t ms = 0;
+  uint32_t rnd = 0;
+  const bool snowflake = post_id_value(id, &ms);
+  const bool packed = !snowflake && pack_post_id(id, &ms, &rnd);
+  std::string out;
+  out.reserve(2 + 8 + (packed ? kTitleIdPackedLen : 1 + id.size()));
+  out.append("t:", 2);
+  put_be(&out, ~(uint64_t)std::max(0L, created_at), 8);
+  if (snowflake) {
+    out.push_back(kTitleIdSnowflake);
+    put_be(&out, ~ms, 8);
+  } else if (packed) {
+    out.push_back(kTitleIdPacked);
+    put_be(&out, ms, 8);
+    put_be(&out, rnd, 4);
+  } else {
+    out.push_back(kTitleIdRaw);
+    out.append(id);
   }
+  return out;
+}
 
-  int on = 1;
-  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+// Every decimal "t:<rev>:<id>" key written before the binary schema.
+constexpr const char* kLegacyTitleBegin = "t:0";
+constexpr const char* kLegacyTitleEnd = "t::";
 
-  sockaddr_in a{};
-  a.sin_family = AF_INET;
-  a.sin_port = htons((uint16_t)cfg_.port);
-  a.sin_addr.s_addr = INADDR_ANY;
+std::string account_index_prefix(const std::string& account_id) {
+  return "u:" + account_id + ":";
+}
 
-  if (bind(fd, (sockaddr*)&a, sizeof(a)) != 0 || listen(fd, 128) != 0) {
-    close(fd);
-    return;
+std::string account_index_key(const std::string& account_id, long created_at, const std::string& id) {
+  return account_index_prefix(account_id) + rev_ts_id(created_at, id);
+}
+
+std::string post_summary(const std::string& id, const std::string& account_id, const std::string& title, long created_at) {
+  return form_build({
+      {"id", id},
+      {"account_id", account_id},
+      {"title", title},
+      {"created_at", std::to_string(created_at)},
+  });
+}
+
+std::vector<std::string> split_csv(const std::string& s) {
+  std::vector<std::string> out;
+  size_t p = 0;
+  while (p <= s.size()) {
+    size_t c = s.find(',', p);
+    if (c == std::string::npos) {
+      c = s.size();
+    }
+    std::string token = tr(s.substr(p, c - p));
+    if (!token.empty()) {
+      out.push_back(token);
+    }
+    if (c == s.size()) {
+      break;
+    }
+    p = c + 1;
   }
-  listen_fd_ = fd;
+  return out;
+}
 
-  while (!stop_) {
-    fd_set s;
-    FD_ZERO(&s);
-    FD_SET(fd, &s);
-    timeval tv{};
-    tv.tv_usec = 200000;
+// h:<account_id> is `nodes=<csv>&verified_at=<ms>`: the nodes that hold the
+// account's posts. verified_at is only set once every node has said whether it
+// has u: rows for the account; until then (and for plain-CSV values written by
+// older builds) the list may miss holders and /post/by_account asks everyone.
+// Broadcasts can be lost, so a verified list is trusted for a bounded time.
+constexpr long kHolderHintTrustMs = 60000;
 
-    if (select(fd + 1, &s, nullptr, nullptr, &tv) <= 0) {
-      continue;
+struct HolderHint {
+  std::vector<std::string> nodes;
+  long verified_at = 0;
+};
+
+HolderHint parse_holders(const std::string& value) {
+  HolderHint h;
+  if (value.find('=') == std::string::npos) {
+    h.nodes = split_csv(value);
+    return h;
+  }
+  auto f = form_parse(value);
+  h.nodes = split_csv(f["nodes"]);
+  try {
+    h.verified_at = f["verified_at"].empty() ? 0 : std::stol(f["verified_at"]);
+  } catch (...) {
+    h.verified_at = 0;
+  }
+  return h;
+}
+
+// Merges ids into h and returns true when the node list grew.
+bool merge_holder_ids(HolderHint* h, const std::vector<std::string>& ids) {
+  bool grew = false;
+  for (const auto& id : ids) {
+    if (std::find(h->nodes.begin(), h->nodes.end(), id) == h->nodes.end()) {
+      h->nodes.push_back(id);
+      grew = true;
     }
+  }
+  std::sort(h->nodes.begin(), h->nodes.end());
+  return grew;
+}
 
-    sockaddr_in ca{};
-    socklen_t cl = sizeof(ca);
-    int cfd = accept(fd, (sockaddr*)&ca, &cl);
-    if (cfd < 0) {
-      continue;
+std::string holders_value(const HolderHint& h) {
+  std::string nodes;
+  for (const auto& id : h.nodes) {
+    if (!nodes.empty()) {
+      nodes.push_back(',');
     }
+    nodes += id;
+  }
+  return form_build({{"nodes", nodes}, {"verified_at", std::to_string(h.verified_at)}});
+}
 
-    std::thread([this, cfd]() {
-      Req q;
-      if (read_req(cfd, &q)) {
-        send_resp(cfd, Handle(q));
+// Title search: titles are split into words on ASCII separators, ASCII is
+// lowercased, and every word yields the bigrams of its UTF-8 characters (a
+// one-character word yields itself). This needs no dictionary and works the
+// same for Hangul and Latin text. Titles also index every single character,
+// so a one-character query word (one Hangul syllable) finds it inside longer
+// words; longer query words only look up their bigrams.
+//
+// Known limits: posting lists shrink only with retention on, where compaction
+// drops docs that lost their d: row (ScanDeadDocs, RetentionFilter); without
+// it docs of deleted or retitled posts stay listed and are skipped at query
+// time. Each merge operand is a full set_union, so a hot token costs O(list)
+// per merge during compaction.
+std::vector<std::string> title_words(const std::string& s) {
+  std::vector<std::string> words;
+  std::string cur;
+  for (unsigned char c : s) {
+    if (c < 0x80 && !std::isalnum(c)) {
+      if (!cur.empty()) {
+        words.push_back(std::move(cur));
+        cur.clear();
       }
-      close(cfd);
-    }).detach();
+      continue;
+    }
+    cur.push_back((char)(c < 0x80 ? std::tolower(c) : c));
   }
+  if (!cur.empty()) {
+    words.push_back(std::move(cur));
+  }
+  return words;
 }
 
-Engine::Resp Engine::Handle(const Req& r) {
-  if (r.method != "POST") {
-    return {405, form_build({{"ok", "0"}, {"error", "method"}})};
+std::vector<std::string> title_tokens(const std::string& s, bool unigrams = false) {
+  std::set<std::string> tokens;
+  for (const auto& w : title_words(s)) {
+    std::vector<size_t> starts;
+    for (size_t i = 0; i < w.size(); i++) {
+      if (((unsigned char)w[i] & 0xC0) != 0x80) {
+        starts.push_back(i);
+      }
+    }
+    starts.push_back(w.size());
+    if (unigrams || starts.size() == 2) {
+      for (size_t i = 0; i + 1 < starts.size(); i++) {
+        tokens.insert(w.substr(starts[i], starts[i + 1] - starts[i]));
+      }
+    }
+    for (size_t i = 0; i + 2 < starts.size(); i++) {
+      tokens.insert(w.substr(starts[i], starts[i + 2] - starts[i]));
+    }
   }
+  return std::vector<std::string>(tokens.begin(), tokens.end());
+}
 
-  if (r.path == "/account/create") return CreateAccount(r);
-  if (r.path == "/account/get") return GetAccount(r);
-  if (r.path == "/post/create") return CreatePost(r);
-  if (r.path == "/post/get") return GetPost(r);
-  if (r.path == "/post/titles") return ListTitles(r);
-
-  if (r.path == "/internal/account/put") return PutAccountInternal(r);
-  if (r.path == "/internal/account/get") return GetAccountInternal(r);
-  if (r.path == "/internal/post/put") return PutPostInternal(r);
-  if (r.path == "/internal/post/get") return GetPostInternal(r);
-  if (r.path == "/internal/post/titles") return ListTitlesInternal(r);
-  if (r.path == "/internal/ping") return Ping();
-
-  return {404, form_build({{"ok", "0"}, {"error", "path"}})};
+std::vector<std::string> title_index_tokens(const std::string& title) {
+  return title_tokens(title, true);
 }
 
-bool Engine::PutAccount(
-    const std::string& id,
-    const std::string& name,
-    const std::string& password_hash,
-    long created_at,
-    bool if_absent,
-    bool* created) {
-  auto* db = static_cast<rocksdb::DB*>(db_);
-  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(acc_cf_);
+std::string search_doc_key(uint32_t doc) {
+  char buf[16];
+  std::snprintf(buf, sizeof(buf), "d:%010u", doc);
+  return buf;
+}
 
-  std::lock_guard<std::mutex> lk(mu_);
-  std::string key = "a:" + id;
+// Posting lists are sorted doc numbers stored as varint deltas.
+void put_varint32(std::string* out, uint32_t v) {
+  while (v >= 0x80) {
+    out->push_back((char)(v | 0x80));
+    v >>= 7;
+  }
+  out->push_back((char)v);
+}
 
-  if (if_absent) {
-    std::string ex;
-    auto st = db->Get(rocksdb::ReadOptions(), cf, key, &ex);
-    if (st.ok()) {
-      *created = false;
-      return true;
+bool decode_postings(const rocksdb::Slice& in, std::vector<uint32_t>* out) {
+  out->clear();
+  const auto* p = (const unsigned char*)in.data();
+  const auto* end = p + in.size();
+  uint32_t prev = 0;
+  while (p < end) {
+    uint32_t v = 0;
+    int shift = 0;
+    while (p < end && (*p & 0x80)) {
+      v |= (uint32_t)(*p++ & 0x7F) << shift;
+      shift += 7;
     }
-    if (!st.IsNotFound()) {
+    if (p == end || shift > 28) {
       return false;
     }
+    v |= (uint32_t)(*p++) << shift;
+    prev += v;
+    out->push_back(prev);
   }
-
-  std::string value = form_build({
-      {"id", id},
-      {"name", name},
-      {"password_hash", password_hash},
-      {"created_at", std::to_string(created_at)},
-  });
-  if (!db->Put(rocksdb::WriteOptions(), cf, key, value).ok()) {
-    return false;
-  }
-  *created = true;
   return true;
 }
 
-bool Engine::PutPost(const Post& p, bool if_absent, bool* created) {
-  auto* db = static_cast<rocksdb::DB*>(db_);
-  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+std::string encode_postings(const std::vector<uint32_t>& docs) {
+  std::string out;
+  out.reserve(docs.size() * 2);
+  uint32_t prev = 0;
+  for (uint32_t d : docs) {
+    put_varint32(&out, d - prev);
+    prev = d;
+  }
+  return out;
+}
 
-  std::lock_guard<std::mutex> lk(mu_);
-  std::string key = "p:" + p.id;
-  std::string old_value;
-  bool had_old = false;
-
-  if (if_absent) {
-    std::string ex;
-    auto st = db->Get(rocksdb::ReadOptions(), cf, key, &ex);
-    if (st.ok()) {
-      *created = false;
-      return true;
-    }
-    if (!st.IsNotFound()) {
+// Operands are single-doc posting lists; merging is a sorted union, so
+// PutPost never has to read a posting list before appending to it.
+class PostingUnion : public rocksdb::AssociativeMergeOperator {
+ public:
+  bool Merge(
+      const rocksdb::Slice&,
+      const rocksdb::Slice* existing_value,
+      const rocksdb::Slice& value,
+      std::string* new_value,
+      rocksdb::Logger*) const override {
+    std::vector<uint32_t> a;
+    std::vector<uint32_t> b;
+    if ((existing_value && !decode_postings(*existing_value, &a)) || !decode_postings(value, &b)) {
       return false;
     }
-  } else {
-    auto st = db->Get(rocksdb::ReadOptions(), cf, key, &old_value);
-    if (st.ok()) {
-      had_old = true;
-    } else if (!st.IsNotFound()) {
-      return false;
+    std::vector<uint32_t> merged;
+    merged.reserve(a.size() + b.size());
+    std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(merged));
+    *new_value = encode_postings(merged);
+    return true;
+  }
+  const char* Name() const override { return "kvs.PostingUnion"; }
+};
+
+// Reads one numeric field without decoding the rest of the record (p: values
+// carry the whole post body). Returns 0 when the field is missing or bad.
+long form_field_long(const rocksdb::Slice& v, const char* name) {
+  const size_t name_len = std::strlen(name);
+  size_t p = 0;
+  while (p < v.size()) {
+    size_t e = p;
+    while (e < v.size() && v[e] != '&') {
+      e++;
+    }
+    if (e - p > name_len && v[p + name_len] == '=' && std::memcmp(v.data() + p, name, name_len) == 0) {
+      long n = 0;
+      for (size_t i = p + name_len + 1; i < e; i++) {
+        if (v[i] < '0' || v[i] > '9') {
+          return 0;
+        }
+        n = n * 10 + (v[i] - '0');
+      }
+      return n;
     }
+    p = e + 1;
   }
+  return 0;
+}
 
-  std::string value = form_build({
-      {"id", p.id},
-      {"account_id", p.account_id},
-      {"title", p.title},
-      {"content", p.content},
-      {"created_at", std::to_string(p.created_at)},
-  });
+// r:<post_id> is `doc=<n>&created_at=<ms>` so the retention filter can drop it
+// with the post; rows written by older builds hold the bare doc number.
+std::string search_ref(uint32_t doc, long created_at) {
+  return form_build({{"doc", std::to_string(doc)}, {"created_at", std::to_string(created_at)}});
+}
+
+uint32_t search_ref_doc(const std::string& ref) {
+  if (ref.find('=') != std::string::npos) {
+    return (uint32_t)form_field_long(ref, "doc");
+  }
+  try {
+    return (uint32_t)std::stoul(ref);
+  } catch (...) {
+    return 0;
+  }
+}
+
+}  // namespace
+
+void DeadDocs::Add(uint32_t doc) {
+  std::lock_guard<std::mutex> lk(mu);
+  if (bits.size() <= doc / 64) {
+    bits.resize(doc / 64 + 1);
+  }
+  bits[doc / 64] |= 1ull << (doc % 64);
+}
+
+// Removes dead docs from a sorted list and returns how many went.
+size_t DeadDocs::Prune(std::vector<uint32_t>* docs) {
+  std::lock_guard<std::mutex> lk(mu);
+  const size_t before = docs->size();
+  docs->erase(std::remove_if(docs->begin(), docs->end(), [&](uint32_t d) {
+    return d / 64 < bits.size() && (bits[d / 64] >> (d % 64) & 1);
+  }), docs->end());
+  return before - docs->size();
+}
+
+namespace {
+
+// Drops posts older than the retention window together with their t:, u: and
+// search d:/r: rows. Every row carries created_at, so each one decides on its
+// own and compaction never needs a cross-CF lookup. Posting lists carry only
+// doc numbers: a dropped d: row marks its doc dead, and s: rows shed dead docs
+// (including ones ScanDeadDocs found at start) whenever they are compacted.
+// With an archive file set, a p: row is only dropped after it was appended
+// there as a bulk-load record (type=post&...), so the archive can be fed back
+// to `kvsd bulk-load`.
+class RetentionFilterFactory : public rocksdb::CompactionFilterFactory {
+ public:
+  RetentionFilterFactory(long retention_ms, std::string archive_path, RetentionStats* stats, DeadDocs* dead)
+      : retention_ms_(retention_ms), archive_path_(std::move(archive_path)), stats_(stats), dead_(dead) {}
+
+  std::unique_ptr<rocksdb::CompactionFilter> CreateCompactionFilter(
+      const rocksdb::CompactionFilter::Context&) override {
+    return std::unique_ptr<rocksdb::CompactionFilter>(new RetentionFilter(this, now_ms() - retention_ms_));
+  }
+  const char* Name() const override { return "kvs.RetentionFilterFactory"; }
+
+ private:
+  class RetentionFilter : public rocksdb::CompactionFilter {
+   public:
+    RetentionFilter(RetentionFilterFactory* owner, long cutoff) : owner_(owner), cutoff_(cutoff) {}
+
+    bool Filter(int, const rocksdb::Slice& key, const rocksdb::Slice& value, std::string* new_value, bool* value_changed) const override {
+      if (key.size() < 2 || key[1] != ':') {
+        return false;
+      }
+      if (key[0] == 's') {
+        return PrunePostings(value, new_value, value_changed);
+      }
+      std::atomic<long>* counter = nullptr;
+      switch (key[0]) {
+        case 'p': counter = &owner_->stats_->posts; break;
+        case 't': counter = &owner_->stats_->titles; break;
+        case 'u': counter = &owner_->stats_->account_rows; break;
+        case 'd': counter = &owner_->stats_->docs; break;
+        case 'r': counter = &owner_->stats_->refs; break;
+        default: return false;
+      }
+      const long created_at = form_field_long(value, "created_at");
+      if (created_at <= 0 || created_at >= cutoff_) {
+        return false;
+      }
+      if (key[0] == 'p' && !owner_->Archive(value)) {
+        return false;
+      }
+      if (key[0] == 'd') {
+        uint32_t doc = 0;
+        for (size_t i = 2; i < key.size(); i++) {
+          doc = doc * 10 + (uint32_t)(key[i] - '0');
+        }
+        owner_->dead_->Add(doc);
+      }
+      counter->fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    const char* Name() const override { return "kvs.RetentionFilter"; }
+
+   private:
+    // Merge operands are left alone; their docs go once they are merged into a value.
+    bool PrunePostings(const rocksdb::Slice& value, std::string* new_value, bool* value_changed) const {
+      std::vector<uint32_t> docs;
+      if (!decode_postings(value, &docs)) {
+        return false;
+      }
+      const size_t pruned = owner_->dead_->Prune(&docs);
+      if (pruned == 0) {
+        return false;
+      }
+      owner_->stats_->postings.fetch_add((long)pruned, std::memory_order_relaxed);
+      if (docs.empty()) {
+        return true;
+      }
+      *new_value = encode_postings(docs);
+      *value_changed = true;
+      return false;
+    }
+
+    RetentionFilterFactory* owner_;
+    long cutoff_;
+  };
+
+  bool Archive(const rocksdb::Slice& value) {
+    if (archive_path_.empty()) {
+      return true;
+    }
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!out_.is_open()) {
+      out_.open(archive_path_, std::ios::binary | std::ios::app);
+    }
+    out_ << "type=post&";
+    out_.write(value.data(), (std::streamsize)value.size());
+    out_ << '\n';
+    out_.flush();
+    if (!out_) {
+      out_.close();
+      out_.clear();
+      stats_->archive_failed.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+    stats_->archived.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  const long retention_ms_;
+  const std::string archive_path_;
+  RetentionStats* stats_;
+  DeadDocs* dead_;
+  std::mutex mu_;
+  std::ofstream out_;
+};
+
+// Intersects two sorted, duplicate-free lists. The SSE2 path compares a block
+// of 4 from each side against all rotations of the other and advances the
+// block with the smaller maximum; the scalar merge finishes the tails.
+size_t intersect_postings(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, uint32_t* out) {
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+#if defined(__SSE2__)
+  while (i + 4 <= na && j + 4 <= nb) {
+    const __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+    const __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+    __m128i eq = _mm_cmpeq_epi32(va, vb);
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x39)));
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x4E)));
+    eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, 0x93)));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+    while (mask) {
+      const int bit = __builtin_ctz((unsigned)mask);
+      out[k++] = a[i + bit];
+      mask &= mask - 1;
+    }
+    const uint32_t amax = a[i + 3];
+    const uint32_t bmax = b[j + 3];
+    if (amax <= bmax) {
+      i += 4;
+    }
+    if (bmax <= amax) {
+      j += 4;
+    }
+  }
+#endif
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (b[j] < a[i]) {
+      j++;
+    } else {
+      out[k++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  return k;
+}
+
+// Assigns the post a node-local doc number (kept while its title is
+// unchanged) and stages d:/r: rows plus one posting merge per title token.
+// `lookup` must see rows staged earlier in the same batch.
+void stage_search_doc(
+    rocksdb::WriteBatch* batch,
+    rocksdb::ColumnFamilyHandle* cf,
+    const std::function<bool(const std::string&, std::string*)>& lookup,
+    std::map<std::string, std::string>* staged,
+    uint32_t* next_doc,
+    const std::string& id,
+    const std::string& title,
+    long created_at,
+    const std::string& summary) {
+  uint32_t doc = 0;
+  std::string ref;
+  if (lookup("r:" + id, &ref)) {
+    const uint32_t old_doc = search_ref_doc(ref);
+    std::string old_summary;
+    if (old_doc > 0 && lookup(search_doc_key(old_doc), &old_summary) && form_parse(old_summary)["title"] == title) {
+      doc = old_doc;
+    } else if (old_doc > 0) {
+      // Postings of the old doc are left behind; queries skip docs without a d: row.
+      batch->Delete(cf, search_doc_key(old_doc));
+      if (staged) {
+        (*staged)[search_doc_key(old_doc)] = "";
+      }
+    }
+  }
+
+  const bool fresh = doc == 0;
+  if (fresh) {
+    doc = ++*next_doc;
+  }
+  batch->Put(cf, search_doc_key(doc), summary);
+  batch->Put(cf, "r:" + id, search_ref(doc, created_at));
+  if (staged) {
+    (*staged)[search_doc_key(doc)] = summary;
+    (*staged)["r:" + id] = search_ref(doc, created_at);
+  }
+  // Merges are a union, so re-staging a kept doc is harmless and lets a
+  // backfill add tokens the index did not cover when the doc was first written.
+  const std::string posting = encode_postings({doc});
+  for (const auto& t : title_index_tokens(title)) {
+    batch->Merge(cf, "s:" + t, posting);
+  }
+}
+
+// Deletes the t:/u: rows of the stored version `old_value` of a post whose
+// replacement (id, account_id, created_at) no longer writes them.
+void stage_stale_post_rows(
+    rocksdb::WriteBatch* batch,
+    rocksdb::ColumnFamilyHandle* cf,
+    const std::string& old_value,
+    const std::string& id,
+    const std::string& account_id,
+    long created_at) {
+  auto old = form_parse(old_value);
+  const std::string old_id = old["id"].empty() ? id : old["id"];
+  long old_created_at = 0;
+  try {
+    old_created_at = std::stol(old["created_at"]);
+  } catch (...) {
+    old_created_at = 0;
+  }
+  if (old_id != id || old_created_at != created_at) {
+    batch->Delete(cf, title_index_key(old_created_at, old_id));
+  }
+  const std::string& old_account_id = old["account_id"];
+  if (!old_account_id.empty() &&
+      (old_account_id != account_id || old_id != id || old_created_at != created_at)) {
+    batch->Delete(cf, account_index_key(old_account_id, old_created_at, old_id));
+  }
+}
+
+}  // namespace
+
+template <class T>
+struct TaskResult {
+  std::optional<T> value;
+  void return_value(T v) { value.emplace(std::move(v)); }
+  T Take() { return std::move(*value); }
+};
+
+template <>
+struct TaskResult<void> {
+  void return_void() {}
+  void Take() {}
+};
+
+// Coroutine returning T, started lazily by the co_await that wants its result.
+// When it finishes, control goes straight back to that awaiter (symmetric
+// transfer, so deep chains do not grow the stack). The frame dies with the
+// Task. Failures travel in Resp, never as exceptions. Keep co_await out of
+// && / || chains: GCC 12 gets the short-circuit wrong after a suspension.
+template <class T>
+class Task {
+ public:
+  struct promise_type : TaskResult<T> {
+    std::coroutine_handle<> continuation;
+
+    Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    struct Final {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+        auto next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    Final final_suspend() noexcept { return {}; }
+    void unhandled_exception() { std::terminate(); }
+  };
+
+  Task(Task&& o) noexcept : h_(std::exchange(o.h_, {})) {}
+  Task& operator=(Task&& o) noexcept {
+    if (this != &o) {
+      if (h_) {
+        h_.destroy();
+      }
+      h_ = std::exchange(o.h_, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (h_) {
+      h_.destroy();
+    }
+  }
+
+  bool await_ready() const noexcept { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept {
+    h_.promise().continuation = awaiter;
+    return h_;
+  }
+  T await_resume() { return h_.promise().Take(); }
+
+ private:
+  explicit Task(std::coroutine_handle<promise_type> h) : h_(h) {}
+  std::coroutine_handle<promise_type> h_;
+};
+
+namespace {
+
+// A coroutine nobody awaits: it starts at once and frees its own frame.
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() noexcept { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() noexcept {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Runs task on the calling thread up to its first suspension.
+Detached Launch(Task<void> task) {
+  co_await std::move(task);
+}
+
+}  // namespace
+
+// One thread that watches sockets and timers for suspended coroutines. It
+// never runs handler code: a ready socket or a due timer posts the waiting
+// coroutine back to the executor with the RequestContext it suspended under.
+// A watch is one-shot and always has a deadline, so nothing parks forever.
+class EventLoop {
+ public:
+  using Clock = std::chrono::steady_clock;
+  class Readiness;
+
+  explicit EventLoop(Executor* exec)
+      : exec_(exec), ep_(epoll_create1(EPOLL_CLOEXEC)), wake_fd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) {
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    epoll_ctl(ep_, EPOLL_CTL_ADD, wake_fd_, &ev);
+    th_ = std::thread(&EventLoop::Run, this);
+  }
+  ~EventLoop() {
+    Stop();
+    close(wake_fd_);
+    close(ep_);
+  }
+  EventLoop(const EventLoop&) = delete;
+  EventLoop& operator=(const EventLoop&) = delete;
+
+  // Pending timers are dropped; call once nothing can be waiting.
+  void Stop() {
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      stop_ = true;
+    }
+    Wake();
+    if (th_.joinable()) {
+      th_.join();
+    }
+  }
+
+  void Resume(std::coroutine_handle<> h, const RequestContext& ctx) {
+    exec_->Post([h, ctx]() {
+      RequestContext::Scope scope(ctx);
+      h.resume();
+    });
+  }
+
+  // fn runs on the loop thread once `at` has passed; it must not block.
+  void At(Clock::time_point at, std::function<void()> fn) {
+    bool wake = false;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      wake = timers_.empty() || at < timers_.begin()->first;
+      timers_.emplace(at, std::move(fn));
+    }
+    if (wake) {
+      Wake();
+    }
+  }
+
+  // co_await Ready(fd, EPOLLIN, until): true once fd is ready, false if
+  // `until` passes first.
+  Readiness Ready(int fd, uint32_t events, Clock::time_point until);
+
+ private:
+  struct Watch {
+    int fd = -1;
+    std::coroutine_handle<> h;
+    RequestContext ctx;
+    bool ready = false;
+  };
+
+  // Registration and firing both hold mu_, so the coroutine cannot be
+  // resumed before Arm() returns. False: fd could not be watched, and the
+  // caller's next syscall reports why.
+  bool Arm(Watch* w, uint32_t events, Clock::time_point until) {
+    bool wake = false;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      const uint64_t id = next_id_++;
+      epoll_event ev{};
+      ev.events = events | EPOLLONESHOT;
+      ev.data.u64 = id;
+      if (epoll_ctl(ep_, EPOLL_CTL_ADD, w->fd, &ev) != 0) {
+        w->ready = true;
+        return false;
+      }
+      watches_[id] = w;
+      wake = timers_.empty() || until < timers_.begin()->first;
+      timers_.emplace(until, [this, id]() { Fire(id, false); });
+    }
+    if (wake) {
+      Wake();
+    }
+    return true;
+  }
+
+  // Readiness and timeout race on the loop thread; the first one wins.
+  void Fire(uint64_t id, bool ready) {
+    std::coroutine_handle<> h;
+    RequestContext ctx;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      auto it = watches_.find(id);
+      if (it == watches_.end()) {
+        return;
+      }
+      Watch* w = it->second;
+      watches_.erase(it);
+      epoll_ctl(ep_, EPOLL_CTL_DEL, w->fd, nullptr);
+      w->ready = ready;
+      h = w->h;
+      ctx = w->ctx;
+    }
+    Resume(h, ctx);
+  }
+
+  void Wake() {
+    const uint64_t one = 1;
+    if (write(wake_fd_, &one, sizeof(one)) < 0) {
+      // Already signalled: the counter is non-zero.
+    }
+  }
+
+  void Run() {
+    epoll_event events[64];
+    for (;;) {
+      int timeout_ms = -1;
+      {
+        std::lock_guard<std::mutex> lk(mu_);
+        if (stop_) {
+          return;
+        }
+        if (!timers_.empty()) {
+          const auto wait = timers_.begin()->first - Clock::now();
+          timeout_ms = (int)std::clamp<long>(
+              std::chrono::ceil<std::chrono::milliseconds>(wait).count(), 0, std::numeric_limits<int>::max());
+        }
+      }
+      const int n = epoll_wait(ep_, events, 64, timeout_ms);
+      for (int i = 0; i < n; i++) {
+        if (events[i].data.u64 == 0) {
+          uint64_t v = 0;
+          if (read(wake_fd_, &v, sizeof(v)) < 0) {
+            // Spurious: nothing to drain.
+          }
+          continue;
+        }
+        Fire(events[i].data.u64, true);
+      }
+      std::vector<std::function<void()>> due;
+      {
+        std::lock_guard<std::mutex> lk(mu_);
+        const auto now = Clock::now();
+        while (!timers_.empty() && timers_.begin()->first <= now) {
+          due.push_back(std::move(timers_.begin()->second));
+          timers_.erase(timers_.begin());
+        }
+      }
+      for (auto& fn : due) {
+        fn();
+      }
+    }
+  }
+
+  Executor* exec_;
+  int ep_;
+  int wake_fd_;
+  std::thread th_;
+  std::mutex mu_;
+  bool stop_ = false;
+  uint64_t next_id_ = 1;  // 0 is wake_fd_
+  std::unordered_map<uint64_t, Watch*> watches_;
+  std::multimap<Clock::time_point, std::function<void()>> timers_;
+};
+
+class EventLoop::Readiness {
+ public:
+  Readiness(EventLoop* loop, int fd, uint32_t events, Clock::time_point until)
+      : loop_(loop), events_(events), until_(until) {
+    w_.fd = fd;
+  }
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<> h) {
+    w_.h = h;
+    w_.ctx = RequestContext::Capture();
+    return loop_->Arm(&w_, events_, until_);
+  }
+  bool await_resume() const noexcept { return w_.ready; }
+
+ private:
+  EventLoop* loop_;
+  uint32_t events_;
+  Clock::time_point until_;
+  Watch w_;
+};
+
+EventLoop::Readiness EventLoop::Ready(int fd, uint32_t events, Clock::time_point until) {
+  return Readiness(this, fd, events, until);
+}
+
+// Set-once flag any number of coroutines can wait on, each with its own
+// timeout (Clock::time_point::max() for none). Set() and a timeout race on
+// the waiter's `fired`; whichever flips it resumes the waiter.
+class Event {
+ public:
+  using Clock = EventLoop::Clock;
+
+  explicit Event(EventLoop* loop) : loop_(loop) {}
+  Event(const Event&) = delete;
+  Event& operator=(const Event&) = delete;
+
+  void Set() {
+    std::vector<std::shared_ptr<Waiter>> waiters;
+    {
+      std::lock_guard<std::mutex> lk(mu_);
+      if (set_) {
+        return;
+      }
+      set_ = true;
+      waiters.swap(waiters_);
+    }
+    for (auto& w : waiters) {
+      if (!w->fired.exchange(true, std::memory_order_acq_rel)) {
+        w->set = true;
+        loop_->Resume(w->h, w->ctx);
+      }
+    }
+  }
+
+ private:
+  struct Waiter {
+    std::coroutine_handle<> h;
+    RequestContext ctx;
+    std::atomic<bool> fired{false};
+    bool set = false;
+  };
+
+ public:
+  // co_await Wait(until): true once Set() was called, false on timeout.
+  class Waiting {
+   public:
+    Waiting(Event* ev, Clock::time_point until) : ev_(ev), until_(until) {}
+    bool await_ready() {
+      std::lock_guard<std::mutex> lk(ev_->mu_);
+      return ev_->set_;
+    }
+    bool await_suspend(std::coroutine_handle<> h) {
+      w_ = std::make_shared<Waiter>();
+      w_->h = h;
+      w_->ctx = RequestContext::Capture();
+      // Set() may resume us as soon as mu_ is released; use copies from here on.
+      std::shared_ptr<Waiter> w = w_;
+      EventLoop* loop = ev_->loop_;
+      const Clock::time_point until = until_;
+      {
+        std::lock_guard<std::mutex> lk(ev_->mu_);
+        if (ev_->set_) {
+          w->set = true;
+          return false;
+        }
+        ev_->waiters_.push_back(w);
+      }
+      if (until != Clock::time_point::max()) {
+        loop->At(until, [w, loop]() {
+          if (!w->fired.exchange(true, std::memory_order_acq_rel)) {
+            loop->Resume(w->h, w->ctx);
+          }
+        });
+      }
+      return true;
+    }
+    bool await_resume() const noexcept { return !w_ || w_->set; }
+
+   private:
+    Event* ev_;
+    Clock::time_point until_;
+    std::shared_ptr<Waiter> w_;
+  };
+
+  Waiting Wait(Clock::time_point until) { return Waiting(this, until); }
+
+ private:
+  EventLoop* loop_;
+  std::mutex mu_;
+  bool set_ = false;
+  std::vector<std::shared_ptr<Waiter>> waiters_;
+};
+
+// co_await WhenAll(loop, tasks): runs the tasks side by side and resumes the
+// caller once every one has finished. Each starts on the calling thread under
+// the caller's RequestContext and runs until its first suspension.
+class WhenAll {
+ public:
+  WhenAll(EventLoop* loop, std::vector<Task<void>> tasks) : loop_(loop), tasks_(std::move(tasks)) {}
+
+  bool await_ready() const noexcept { return tasks_.empty(); }
+  bool await_suspend(std::coroutine_handle<> h) {
+    parent_ = h;
+    ctx_ = RequestContext::Capture();
+    // The extra count is ours: no task can resume the caller mid-launch.
+    left_.store(tasks_.size() + 1, std::memory_order_relaxed);
+    for (auto& task : tasks_) {
+      RequestContext::Scope scope(ctx_);
+      Run(this, std::move(task));
+    }
+    // Last one out (tasks that never suspended): carry on without suspending.
+    return left_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+  }
+  void await_resume() const noexcept {}
+
+ private:
+  static Detached Run(WhenAll* all, Task<void> task) {
+    co_await std::move(task);
+    if (all->left_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      all->loop_->Resume(all->parent_, all->ctx_);
+    }
+  }
+
+  EventLoop* loop_;
+  std::vector<Task<void>> tasks_;
+  std::atomic<size_t> left_{0};
+  std::coroutine_handle<> parent_;
+  RequestContext ctx_;
+};
+
+namespace {
+
+// post() for coroutines: the same exchange on a non-blocking socket, with the
+// caller parked on the loop whenever the socket would block. timeout_ms
+// bounds the whole exchange rather than each send/recv.
+Task<CRes> async_post(EventLoop* loop, NodeInfo n, std::string path, std::string body, int timeout_ms,
+                      long deadline_ms, CallCancel* cancel) {
+  CRes r;
+  const auto until = EventLoop::Clock::now() + std::chrono::milliseconds(timeout_ms);
+
+  addrinfo hint{};
+  hint.ai_family = AF_UNSPEC;
+  hint.ai_socktype = SOCK_STREAM;
+
+  addrinfo* res = nullptr;
+  {
+    Executor::Blocking blocking;
+    if (getaddrinfo(n.host.c_str(), std::to_string(n.port).c_str(), &hint, &res) != 0) {
+      co_return r;
+    }
+  }
+
+  int fd = -1;
+  for (auto* x = res; x; x = x->ai_next) {
+    fd = socket(x->ai_family, x->ai_socktype | SOCK_NONBLOCK, x->ai_protocol);
+    if (fd < 0) {
+      continue;
+    }
+    // Attached before connect: a cancel shuts the socket down mid-handshake,
+    // which wakes the wait below instead of leaving it to run out the timeout.
+    if (cancel && !cancel->Attach(fd)) {
+      close(fd);
+      fd = -1;
+      break;
+    }
+    bool connected = connect(fd, x->ai_addr, x->ai_addrlen) == 0;
+    if (!connected && errno == EINPROGRESS) {
+      const bool ready = co_await loop->Ready(fd, EPOLLOUT, until);
+      int err = 0;
+      socklen_t len = sizeof(err);
+      connected = ready && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+    }
+    // A socket shut down while connecting can still report no error.
+    if (connected && !(cancel && cancel->Cancelled())) {
+      break;
+    }
+    if (cancel) {
+      cancel->Detach();
+    }
+    close(fd);
+    fd = -1;
+  }
+
+  freeaddrinfo(res);
+  if (fd < 0) {
+    co_return r;
+  }
+  auto drop = [&]() {
+    if (cancel) {
+      cancel->Detach();
+    }
+    close(fd);
+  };
+
+  const std::string wire = request_wire(n.host, n.port, path, body, deadline_ms);
+  for (size_t off = 0; off < wire.size();) {
+    const ssize_t k = send(fd, wire.data() + off, wire.size() - off, MSG_NOSIGNAL);
+    if (k > 0) {
+      off += (size_t)k;
+      continue;
+    }
+    if (k < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      const bool ready = co_await loop->Ready(fd, EPOLLOUT, until);
+      if (ready) {
+        continue;
+      }
+    }
+    drop();
+    co_return r;
+  }
+
+  // Read straight into the reply: no buffer in the frame while parked.
+  std::string data;
+  for (;;) {
+    constexpr size_t kChunk = 4096;
+    const size_t have = data.size();
+    data.resize(have + kChunk);
+    const ssize_t k = recv(fd, data.data() + have, kChunk, 0);
+    const int err = errno;
+    data.resize(have + (size_t)std::max<ssize_t>(k, 0));
+    if (k > 0) {
+      continue;
+    }
+    if (k < 0 && (err == EAGAIN || err == EWOULDBLOCK)) {
+      const bool ready = co_await loop->Ready(fd, EPOLLIN, until);
+      if (ready) {
+        continue;
+      }
+    }
+    break;
+  }
+  drop();
+  // A shutdown() mid-reply looks like a clean EOF; never hand back a cut-off body.
+  if (cancel && cancel->Cancelled()) {
+    co_return r;
+  }
+  co_return parse_reply(data);
+}
+
+}  // namespace
+
+Engine::Engine(Config cfg)
+    : cfg_(std::move(cfg)), nodes_(parse_nodes(cfg_.cluster_nodes)) {
+  const int threads = cfg_.executor_threads > 0 ? cfg_.executor_threads : (int)std::max(1u, std::thread::hardware_concurrency());
+  exec_.reset(new Executor(threads, cfg_.executor_max_threads));
+  loop_.reset(new EventLoop(exec_.get()));
+  if (cfg_.single_node) {
+    nodes_.clear();
+    nodes_.push_back({cfg_.node_id, "127.0.0.1", cfg_.port});
+  } else {
+    bool self = false;
+    for (size_t i = 0; i < nodes_.size(); i++) {
+      if (nodes_[i].id == cfg_.node_id) {
+        // CLUSTER_NODES position: unique per node without any coordination.
+        id_node_ = (uint32_t)i % kBulkLoadIdNode;
+        self = true;
+        break;
+      }
+    }
+    if (!self) {
+      id_node_ = (uint32_t)nodes_.size() % kBulkLoadIdNode;
+      nodes_.push_back({cfg_.node_id, "127.0.0.1", cfg_.port});
+    }
+  }
+  // nodes_ is fixed from here on; every copy handed to a worker carries its slot.
+  for (size_t i = 0; i < nodes_.size(); i++) {
+    nodes_[i].slot = (int)i;
+  }
+  live_.reset(new Liveness[nodes_.size()]());
+
+  limits_.reset(new RouteLimit[kLimitedRouteCount]());
+  const int initial = std::max(kMinRouteLimit, std::min(cfg_.adaptive_limit_initial, std::max(kMinRouteLimit, cfg_.adaptive_limit_max)));
+  for (int i = 0; i < kLimitedRouteCount; i++) {
+    limits_[i].limit = initial;
+    limits_[i].cap.store(initial, std::memory_order_relaxed);
+  }
+}
+
+std::string Engine::NewPostId(long* created_at) {
+  // id_clock_ is the last (ms << kIdSeqBits | seq) handed out. A clock that
+  // steps back keeps counting from there instead of reusing ids, and a full
+  // sequence carries into the next ms.
+  uint64_t last = id_clock_.load(std::memory_order_relaxed);
+  uint64_t next = 0;
+  do {
+    const uint64_t now = (uint64_t)std::max(0L, now_ms()) << kIdSeqBits;
+    next = now > last ? now : last + 1;
+  } while (!id_clock_.compare_exchange_weak(last, next, std::memory_order_relaxed));
+
+  const uint64_t ms = next >> kIdSeqBits;
+  const uint64_t seq = next & ((1u << kIdSeqBits) - 1);
+  if (db_ && ms > id_lease_.load(std::memory_order_acquire)) {
+    ExtendIdLease(ms);
+  }
+  if (created_at) {
+    *created_at = (long)ms;
+  }
+  return post_id_text(ms << (kIdNodeBits + kIdSeqBits) | (uint64_t)id_node_ << kIdSeqBits | seq);
+}
+
+// Persists ms + kIdLeaseMs before any id in (lease, ms] leaves NewPostId, so
+// one synced write covers a second of ids and a restart never goes below it.
+void Engine::ExtendIdLease(uint64_t ms) {
+  std::lock_guard<std::mutex> lk(id_lease_mu_);
+  if (ms <= id_lease_.load(std::memory_order_relaxed)) {
+    return;
+  }
+  const uint64_t lease = ms + kIdLeaseMs;
+  rocksdb::WriteOptions wo;
+  wo.sync = true;
+  if (!static_cast<rocksdb::DB*>(db_)->Put(wo, static_cast<rocksdb::ColumnFamilyHandle*>(def_cf_), kIdLeaseKey, std::to_string(lease)).ok()) {
+    // Left unextended so the next id tries again.
+    std::cerr << "[kvs] post id lease write failed" << std::endl;
+    return;
+  }
+  id_lease_.store(lease, std::memory_order_release);
+}
+
+Engine::~Engine() {
+  Stop();
+}
+
+bool Engine::InitDb() {
+  std::error_code ec;
+  std::filesystem::create_directories(cfg_.db_path, ec);
+  if (ec) {
+    return false;
+  }
+
+  std::vector<std::string> names;
+  if (std::filesystem::exists(cfg_.db_path + "/CURRENT")) {
+    rocksdb::Options o;
+    if (!rocksdb::DB::ListColumnFamilies(o, cfg_.db_path, &names).ok()) {
+      return false;
+    }
+  }
+
+  auto add = [&](const std::string& n) {
+    if (std::find(names.begin(), names.end(), n) == names.end()) {
+      names.push_back(n);
+    }
+  };
+  add(rocksdb::kDefaultColumnFamilyName);
+  add("account");
+  add("post");
+  add("search");
+
+  // One block cache for every CF. Index/filter blocks live in it (so they are
+  // bounded too) and L0 ones stay pinned, which is what warm-up relies on.
+  rocksdb::BlockBasedTableOptions table;
+  table.block_cache = rocksdb::NewLRUCache((size_t)std::max(8, cfg_.block_cache_mb) << 20);
+  table.filter_policy.reset(rocksdb::NewBloomFilterPolicy(10));
+  table.cache_index_and_filter_blocks = true;
+  table.pin_l0_filter_and_index_blocks_in_cache = true;
+  std::shared_ptr<rocksdb::TableFactory> table_factory(rocksdb::NewBlockBasedTableFactory(table));
+
+  std::shared_ptr<rocksdb::CompactionFilterFactory> retention;
+  if (cfg_.retention_days > 0) {
+    std::string archive_path;
+    if (!cfg_.retention_archive_dir.empty()) {
+      std::filesystem::create_directories(cfg_.retention_archive_dir, ec);
+      archive_path = cfg_.retention_archive_dir + "/" + cfg_.node_id + ".txt";
+    }
+    retention = std::make_shared<RetentionFilterFactory>((long)cfg_.retention_days * 86400000L, archive_path, &retention_, &dead_docs_);
+  }
+
+  std::vector<rocksdb::ColumnFamilyDescriptor> desc;
+  for (const auto& n : names) {
+    rocksdb::ColumnFamilyOptions co;
+    co.table_factory = table_factory;
+    if (n == "post" && cfg_.blob_enabled) {
+      // Post bodies go to blob files so compactions only rewrite keys, t: rows and small values.
+      co.enable_blob_files = true;
+      co.min_blob_size = (uint64_t)std::max(0, cfg_.blob_min_size);
+      co.blob_compression_type = compression_type(cfg_.blob_compression);
+      co.enable_blob_garbage_collection = true;
+      co.blob_garbage_collection_age_cutoff = std::min(100, std::max(0, cfg_.blob_gc_age_cutoff_pct)) / 100.0;
+    }
+    if (n == "search") {
+      co.merge_operator = std::make_shared<PostingUnion>();
+    }
+    if (retention && (n == "post" || n == "search")) {
+      // Periodic compaction makes sure cold files are filtered even without new writes.
+      co.compaction_filter_factory = retention;
+      co.periodic_compaction_seconds = 86400;
+    }
+    desc.emplace_back(n, co);
+  }
+
+  rocksdb::DBOptions o;
+  o.create_if_missing = true;
+  o.create_missing_column_families = true;
+  // Repair writes without a WAL are only durable once flushed; flushing every
+  // CF together keeps the backfill cursor from outliving its index rows.
+  o.atomic_flush = cfg_.repair_disable_wal;
+
+  rocksdb::DB* db = nullptr;
+  std::vector<rocksdb::ColumnFamilyHandle*> handles;
+  if (!rocksdb::DB::Open(o, cfg_.db_path, desc, &handles, &db).ok()) {
+    return false;
+  }
+
+  db_ = db;
+  for (size_t i = 0; i < names.size(); i++) {
+    cfs_.push_back(handles[i]);
+    if (names[i] == rocksdb::kDefaultColumnFamilyName) {
+      def_cf_ = handles[i];
+    } else if (names[i] == "account") {
+      acc_cf_ = handles[i];
+    } else if (names[i] == "post") {
+      post_cf_ = handles[i];
+    } else if (names[i] == "search") {
+      search_cf_ = handles[i];
+    }
+  }
+  if (!def_cf_ || !acc_cf_ || !post_cf_ || !search_cf_) {
+    return false;
+  }
+
+  std::string next_doc;
+  if (db->Get(rocksdb::ReadOptions(), static_cast<rocksdb::ColumnFamilyHandle*>(search_cf_), kSearchNextDocKey, &next_doc).ok()) {
+    try {
+      search_next_doc_ = (uint32_t)std::stoul(next_doc);
+    } catch (...) {
+      search_next_doc_ = 0;
+    }
+  }
+
+  // Restart on a clock that stepped back: continue after the last leased ms
+  // instead of handing out ids this node may already have issued.
+  std::string lease;
+  uint64_t leased = 0;
+  if (db->Get(rocksdb::ReadOptions(), static_cast<rocksdb::ColumnFamilyHandle*>(def_cf_), kIdLeaseKey, &lease).ok() &&
+      std::from_chars(lease.data(), lease.data() + lease.size(), leased).ec == std::errc()) {
+    const long now = now_ms();
+    if (now >= 0 && (uint64_t)now < leased) {
+      std::cerr << "[kvs] clock is " << (leased - (uint64_t)now) << "ms behind the post id lease, ids continue from the lease" << std::endl;
+    }
+    id_clock_.store(((leased + 1) << kIdSeqBits) - 1, std::memory_order_relaxed);
+  }
+  id_lease_.store(leased, std::memory_order_relaxed);
+  return true;
+}
+
+void Engine::CloseDb() {
+  for (void* h : cfs_) {
+    delete static_cast<rocksdb::ColumnFamilyHandle*>(h);
+  }
+  cfs_.clear();
+  def_cf_ = nullptr;
+  acc_cf_ = nullptr;
+  post_cf_ = nullptr;
+  search_cf_ = nullptr;
+
+  if (db_) {
+    delete static_cast<rocksdb::DB*>(db_);
+    db_ = nullptr;
+  }
+}
+
+bool Engine::Start() {
+  if (!cfg_.bootstrap_from.empty() && !BootstrapFromPeer()) {
+    std::cerr << "[kvs] bootstrap from " << cfg_.bootstrap_from << " failed, starting with local data" << std::endl;
+  }
+  if (!InitDb()) {
+    return false;
+  }
+  // Checkpoints left by a previous process are never released by their reader.
+  std::error_code ec;
+  std::filesystem::remove_all(cfg_.db_path + ".checkpoints", ec);
+  std::cout << "[kvs] node=" << cfg_.node_id
+            << " listen=0.0.0.0:" << cfg_.port
+            << " db_path=" << cfg_.db_path
+            << " single_node=" << (cfg_.single_node ? "true" : "false")
+            << " cluster_nodes=" << cfg_.cluster_nodes
+            << std::endl;
+  stop_ = false;
+
+  std::string marker;
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* def_cf = static_cast<rocksdb::ColumnFamilyHandle*>(def_cf_);
+  index_ready_ = db->Get(rocksdb::ReadOptions(), def_cf, kIndexBackfillKey, &marker).ok() && marker == kIndexBackfillDone;
+  if (!index_ready_) {
+    // A fresh DB has nothing to backfill; without the marker a node started
+    // with KVS_TITLE_BACKFILL_ON_START=0 would stay degraded until a rebuild.
+    std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(rocksdb::ReadOptions(), static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_)));
+    it->Seek("p:");
+    const bool empty = it->status().ok() && !(it->Valid() && it->key().starts_with("p:"));
+    if (empty && db->Put(rocksdb::WriteOptions(), def_cf, kIndexBackfillKey, kIndexBackfillDone).ok()) {
+      index_ready_ = true;
+    }
+  }
+  if (!index_ready_ && cfg_.title_backfill_on_start) {
+    StartTitleBackfill();
+  }
+
+  warm_ = !cfg_.warmup_enabled || cfg_.warmup_budget_ms <= 0;
+  if (!warm_) {
+    exec_->Post([this]() { Warmup(); });
+  }
+  if (cfg_.retention_days > 0) {
+    exec_->Post([this]() { ScanDeadDocs(); });
+  }
+  exec_->Post([this]() { RepairStaleRows(); });
+
+  if (cfg_.wal_sync_interval_ms > 0) {
+    wal_th_ = std::thread(&Engine::WalSyncLoop, this);
+  }
+
+  th_ = std::thread(&Engine::Serve, this);
+  return true;
+}
+
+void Engine::Stop() {
+  if (stop_) {
+    return;
+  }
+  stop_ = true;
+  if (listen_fd_ >= 0) {
+    close(listen_fd_);
+    listen_fd_ = -1;
+  }
+  if (th_.joinable()) {
+    th_.join();
+  }
+  // A request parked on the loop is no executor task: let every accepted one
+  // reply while the executor still takes its resumptions. Each wait is bounded.
+  {
+    std::unique_lock<std::mutex> lk(responding_mu_);
+    responding_cv_.wait(lk, [&]() { return responding_.load(std::memory_order_acquire) == 0; });
+  }
+  {
+    std::lock_guard<std::mutex> lk(wal_mu_);
+  }
+  wal_cv_.notify_all();
+  {
+    std::lock_guard<std::mutex> lk(index_mu_);
+  }
+  index_cv_.notify_all();
+  if (wal_th_.joinable()) {
+    wal_th_.join();
+  }
+  // In-flight requests, warm-up and backfill see stop_ and finish.
+  exec_->Shutdown();
+  loop_->Stop();
+  CloseDb();
+}
+
+// Client side of bulk ingestion (`kvsd bulk-load <file>`): accounts go to every
+// node and each post to its two HRW owners, exactly as the online write
+// paths place them; holder hints are sent along so /post/by_account works.
+bool Engine::BulkLoad(const std::string& path) {
+  std::ifstream in(path);
+  if (!in) {
+    std::cerr << "[kvs] bulk-load: cannot open " << path << std::endl;
+    return false;
+  }
+
+  id_node_ = kBulkLoadIdNode;
+  std::map<std::string, std::vector<std::string>> lines;
+  std::map<std::string, std::set<std::string>> holders;
+  long records = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    line = tr(line);
+    if (line.empty() || line[0] == '#') {
+      continue;
+    }
+    auto f = form_parse(line);
+    if (f["type"] == "account") {
+      // Timestamps are fixed here so every replica stores the same record.
+      const std::string rec = form_build({
+          {"type", "account"},
+          {"id", f["id"]},
+          {"name", f["name"]},
+          {"password_hash", f["password_hash"]},
+          {"created_at", f["created_at"].empty() ? std::to_string(now_ms()) : f["created_at"]},
+      });
+      for (const auto& n : nodes_) {
+        lines[n.id].push_back(rec);
+      }
+    } else if (f["type"] == "post") {
+      std::string id = f["id"].empty() ? NewPostId() : f["id"];
+      const std::string rec = form_build({
+          {"type", "post"},
+          {"id", id},
+          {"account_id", f["account_id"]},
+          {"title", f["title"]},
+          {"content", f["content"]},
+          {"created_at", f["created_at"].empty() ? std::to_string(now_ms()) : f["created_at"]},
+      });
+      auto owners = PostOwners(id, false);
+      for (size_t i = 0; i < owners.size() && i < 2; i++) {
+        lines[owners[i].id].push_back(rec);
+        holders[f["account_id"]].insert(owners[i].id);
+      }
+    } else {
+      continue;
+    }
+    records++;
+  }
+
+  if (!cfg_.single_node) {
+    for (const auto& kv : holders) {
+      std::string ids;
+      for (const auto& id : kv.second) {
+        ids += (ids.empty() ? "" : ",") + id;
+      }
+      const std::string rec = form_build({{"type", "holders"}, {"account_id", kv.first}, {"nodes", ids}});
+      for (const auto& n : nodes_) {
+        lines[n.id].push_back(rec);
+      }
+    }
+  }
+
+  std::cout << "[kvs] bulk-load records=" << records << " nodes=" << lines.size() << std::endl;
+  for (const auto& n : nodes_) {
+    const auto& node_lines = lines[n.id];
+    for (size_t begin = 0; begin < node_lines.size(); begin += kBulkLinesPerCall) {
+      const size_t end = std::min(node_lines.size(), begin + kBulkLinesPerCall);
+      std::string body;
+      for (size_t i = begin; i < end; i++) {
+        body += node_lines[i];
+        body.push_back('\n');
+      }
+      int status = 0;
+      std::string out;
+      if (!Call(n, "/internal/bulk/ingest", body, &status, &out, kBulkCallTimeoutMs) || status != 200) {
+        std::cerr << "[kvs] bulk-load: node=" << n.id << " failed status=" << status << std::endl;
+        return false;
+      }
+      std::cout << "[kvs] bulk-load node=" << n.id << " lines=" << end << "/" << node_lines.size() << std::endl;
+    }
+  }
+  return true;
+}
+
+void Engine::Serve() {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) {
+    return;
+  }
+
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+  sockaddr_in a{};
+  a.sin_family = AF_INET;
+  a.sin_port = htons((uint16_t)cfg_.port);
+  a.sin_addr.s_addr = INADDR_ANY;
+
+  if (bind(fd, (sockaddr*)&a, sizeof(a)) != 0 || listen(fd, 128) != 0) {
+    close(fd);
+    return;
+  }
+  listen_fd_ = fd;
+
+  while (!stop_) {
+    fd_set s;
+    FD_ZERO(&s);
+    FD_SET(fd, &s);
+    timeval tv{};
+    tv.tv_usec = 200000;
+
+    if (select(fd + 1, &s, nullptr, nullptr, &tv) <= 0) {
+      continue;
+    }
+
+    sockaddr_in ca{};
+    socklen_t cl = sizeof(ca);
+    int cfd = accept(fd, (sockaddr*)&ca, &cl);
+    if (cfd < 0) {
+      continue;
+    }
+
+    // A client that never sends must not hold a worker (or Stop()) forever.
+    timeval io{kClientIoTimeoutMs / 1000, (kClientIoTimeoutMs % 1000) * 1000};
+    setsockopt(cfd, SOL_SOCKET, SO_RCVTIMEO, &io, sizeof(io));
+    setsockopt(cfd, SOL_SOCKET, SO_SNDTIMEO, &io, sizeof(io));
+    responding_.fetch_add(1, std::memory_order_relaxed);
+    exec_->Post([this, cfd]() {
+      Req q;
+      bool ok = false;
+      {
+        Executor::Blocking blocking;
+        ok = read_req(cfd, &q);
+      }
+      if (!ok) {
+        close(cfd);
+        Responded();
+        return;
+      }
+      // Runs here up to its first co_await; from then on the loop resumes it.
+      RequestContext::Scope scope({});
+      Launch(Respond(cfd, std::move(q)));
+    });
+  }
+}
+
+// One request from Handle() to the reply. Its arena lives in this frame,
+// across every co_await below, so it is the suspendable kind.
+Task<void> Engine::Respond(int cfd, Req q) {
+  {
+    RequestArena arena(RequestArena::kSuspendable);
+    RequestDeadline request_deadline(q.deadline_ms);
+    Resp resp = co_await Handle(q);
+    Executor::Blocking blocking;
+    send_resp(cfd, resp);
+  }
+  close(cfd);
+  Responded();
+}
+
+// The last reply wakes Stop(); taking the mutex orders the notify after its
+// check, so the wake-up cannot slip in between.
+void Engine::Responded() {
+  if (responding_.fetch_sub(1, std::memory_order_release) == 1) {
+    std::lock_guard<std::mutex> lk(responding_mu_);
+    responding_cv_.notify_all();
+  }
+}
+
+Task<Engine::Resp> Engine::Handle(const Req& r) {
+  if (r.method != "POST") {
+    co_return {405, form_build({{"ok", "0"}, {"error", "method"}})};
+  }
+  if (!warm_.load(std::memory_order_acquire) && refused_while_warming(r.path)) {
+    co_return {503, form_build({{"ok", "0"}, {"error", "warming"}})};
+  }
+  // The caller has already given up; don't spend RocksDB or peer time on it.
+  if (RequestDeadline::Passed()) {
+    co_return {504, form_build({{"ok", "0"}, {"error", "deadline"}})};
+  }
+
+  const int route = limited_route(r.path);
+  if (route < 0) {
+    co_return co_await Route(r);
+  }
+  // Replication writes were already admitted by the peer that took the public
+  // write; shedding them here would only leave a replica behind.
+  const bool limited = cfg_.adaptive_limit_enabled && kLimitedRoutes[route].cls != kClassInternalWrite;
+  if (limited && !AdmitRoute(route)) {
+    co_return {429, form_build({{"ok", "0"}, {"error", "overloaded"}})};
+  }
+  // Time queued for a slot counts toward the route's latency: that is where
+  // overload shows first.
+  const auto started = std::chrono::steady_clock::now();
+  Resp resp;
+  const bool admitted = co_await AcquireSlot(kLimitedRoutes[route].cls, &resp);
+  if (admitted) {
+    resp = co_await Route(r);
+    ReleaseSlot();
+  }
+  if (limited) {
+    ReleaseRoute(route, elapsed_us(started));
+  }
+  co_return resp;
+}
+
+Task<Engine::Resp> Engine::Route(const Req& r) {
+  if (r.path == "/account/create") co_return CreateAccount(r);
+  if (r.path == "/account/get") co_return co_await GetAccount(r);
+  if (r.path == "/post/create") co_return CreatePost(r);
+  if (r.path == "/post/get") co_return co_await GetPost(r);
+  if (r.path == "/post/titles") co_return co_await ListTitles(r);
+  if (r.path == "/post/by_account") co_return co_await ListByAccount(r);
+  if (r.path == "/post/search") co_return co_await Search(r);
+
+  if (r.path == "/internal/account/put") co_return PutAccountInternal(r);
+  if (r.path == "/internal/account/get") co_return GetAccountInternal(r);
+  if (r.path == "/internal/post/put") co_return PutPostInternal(r);
+  if (r.path == "/internal/post/get") co_return GetPostInternal(r);
+  if (r.path == "/internal/post/titles") co_return co_await ListTitlesInternal(r);
+  if (r.path == "/internal/post/by_account") co_return ListByAccountInternal(r);
+  if (r.path == "/internal/post/search") co_return SearchInternal(r);
+  if (r.path == "/internal/checkpoint/create") co_return CreateCheckpoint();
+  if (r.path == "/internal/checkpoint/file") co_return CheckpointFile(r);
+  if (r.path == "/internal/checkpoint/release") co_return ReleaseCheckpoint(r);
+  if (r.path == "/internal/bulk/ingest") co_return BulkIngest(r);
+  if (r.path == "/internal/account/holders") co_return PutHoldersInternal(r);
+  if (r.path == "/internal/ping") co_return Ping();
+  if (r.path == "/internal/wal/sync") co_return SyncWal();
+  if (r.path == "/internal/stats/writes") co_return WriteStats();
+  if (r.path == "/internal/stats/peers") co_return PeerStats();
+  if (r.path == "/internal/stats/limits") co_return LimitStats();
+  if (r.path == "/internal/stats/sched") co_return SchedStats();
+  if (r.path == "/internal/stats/executor") co_return ExecutorStats();
+  if (r.path == "/internal/stats/retention") co_return RetentionStatus();
+  if (r.path == "/internal/retention/compact") co_return RetentionCompact();
+  if (r.path == "/internal/index/titles/rebuild") co_return RebuildTitleIndex(r);
+
+  co_return {404, form_build({{"ok", "0"}, {"error", "path"}})};
+}
+
+// Over the limit: turned away at once instead of queueing behind work the
+// node can't finish in time.
+bool Engine::AdmitRoute(int route) {
+  RouteLimit& l = limits_[route];
+  if (l.inflight.fetch_add(1, std::memory_order_acq_rel) >= l.cap.load(std::memory_order_relaxed)) {
+    l.inflight.fetch_sub(1, std::memory_order_acq_rel);
+    l.rejected.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  l.admitted.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+// Gradient update per completed request: long_rtt tracks what the route
+// costs unloaded, short_rtt what it costs now. Queueing pushes short above
+// long and the limit shrinks by their ratio (to half at most); otherwise it
+// grows by sqrt(limit), smoothed, so it settles at the node's knee.
+void Engine::ReleaseRoute(int route, long us) {
+  RouteLimit& l = limits_[route];
+  const int inflight = l.inflight.fetch_sub(1, std::memory_order_acq_rel);
+  const double rtt = (double)std::max(1L, us);
+
+  std::lock_guard<std::mutex> lk(l.mu);
+  if (l.long_rtt_us <= 0) {
+    l.long_rtt_us = l.short_rtt_us = rtt;
+  }
+  l.short_rtt_us += (rtt - l.short_rtt_us) / kShortRttSamples;
+  l.long_rtt_us += (rtt - l.long_rtt_us) / kLongRttSamples;
+  // After an overload the long average is inflated; let it come back down.
+  if (l.long_rtt_us > 2 * l.short_rtt_us) {
+    l.long_rtt_us *= 0.95;
+  }
+  // A route using under half its limit says nothing about where the limit is.
+  if (inflight < l.limit / 2) {
+    return;
+  }
+  const double gradient = std::max(0.5, std::min(1.0, kLimitTolerance * l.long_rtt_us / l.short_rtt_us));
+  const double next = l.limit * gradient + std::sqrt(l.limit);
+  const int max_limit = std::max(kMinRouteLimit, cfg_.adaptive_limit_max);
+  l.limit = std::max<double>(kMinRouteLimit, std::min<double>(max_limit, l.limit * 0.8 + next * 0.2));
+  l.cap.store((int)l.limit, std::memory_order_relaxed);
+}
+
+int Engine::SlotCap(RequestClass c) const {
+  if (c == kClassInternalWrite || c == kClassInternalRead) {
+    return cfg_.sched_slots;
+  }
+  return std::max(1, cfg_.sched_slots - cfg_.sched_slots / 4);
+}
+
+// Runs at once while a slot is free for the class, otherwise queues behind
+// its class. A full queue sheds right away; a waiter not granted a slot
+// within the class's wait (or before its deadline) is shed too. Internal
+// writes are never shed for load: past their queue or wait they run over
+// the slot count instead (counted as forced). A queued request parks on the
+// event loop, not on a worker.
+Task<bool> Engine::AcquireSlot(RequestClass c, Resp* shed) {
+  if (cfg_.sched_slots <= 0) {
+    co_return true;
+  }
+  const int queue_max[kRequestClasses] = {
+      cfg_.sched_queue_internal_write, cfg_.sched_queue_public_write, cfg_.sched_queue_internal_read, cfg_.sched_queue_public_read};
+  const int wait_ms[kRequestClasses] = {
+      cfg_.sched_wait_ms_internal_write, cfg_.sched_wait_ms_public_write, cfg_.sched_wait_ms_internal_read, cfg_.sched_wait_ms_public_read};
+  SchedClass& k = sched_[c];
+  SchedWaiter w;
+  const auto queued_at = std::chrono::steady_clock::now();
+  {
+    std::lock_guard<std::mutex> lk(sched_mu_);
+    if (sched_running_ < SlotCap(c)) {
+      sched_running_++;
+      k.started++;
+      co_return true;
+    }
+    if ((int)k.queue.size() >= queue_max[c]) {
+      if (c == kClassInternalWrite) {
+        sched_running_++;
+        k.forced++;
+        co_return true;
+      }
+      k.shed_full++;
+      *shed = {429, form_build({{"ok", "0"}, {"error", "overloaded"}})};
+      co_return false;
+    }
+    w.ready = std::make_unique<Event>(loop_.get());
+    k.queue.push_back(&w);
+  }
+
+  long wait_budget_ms = std::max(0, wait_ms[c]);
+  const long deadline_ms = RequestDeadline::At();
+  if (deadline_ms > 0) {
+    wait_budget_ms = std::max(0L, std::min(wait_budget_ms, deadline_ms - now_ms()));
+  }
+  co_await w.ready->Wait(queued_at + std::chrono::milliseconds(wait_budget_ms));
+
+  // granted, not the wait's result, decides: GrantSlots() may have picked us
+  // between the timeout firing and this lock.
+  std::lock_guard<std::mutex> lk(sched_mu_);
+  const long us = elapsed_us(queued_at);
+  k.waited++;
+  k.wait_us += us;
+  k.max_wait_us = std::max(k.max_wait_us, us);
+  if (!w.granted) {
+    k.queue.erase(std::find(k.queue.begin(), k.queue.end(), &w));
+    if (c == kClassInternalWrite) {
+      sched_running_++;
+      k.forced++;
+      co_return true;
+    }
+    k.shed_wait++;
+    *shed = RequestDeadline::Passed()
+        ? Resp{504, form_build({{"ok", "0"}, {"error", "deadline"}})}
+        : Resp{429, form_build({{"ok", "0"}, {"error", "overloaded"}})};
+    co_return false;
+  }
+  k.started++;
+  co_return true;
+}
+
+void Engine::ReleaseSlot() {
+  if (cfg_.sched_slots <= 0) {
+    return;
+  }
+  std::lock_guard<std::mutex> lk(sched_mu_);
+  sched_running_--;
+  GrantSlots();
+}
+
+// Smooth weighted round robin over the classes that have waiters and may
+// take a slot now: every pick adds each eligible class's weight to its
+// credit and serves the highest, which then pays back the round's total.
+// Internal writes get most slots, yet public reads are never starved.
+// Called with sched_mu_ held.
+void Engine::GrantSlots() {
+  while (sched_running_ < cfg_.sched_slots) {
+    int total = 0;
+    int best = -1;
+    for (int c = 0; c < kRequestClasses; c++) {
+      SchedClass& k = sched_[c];
+      if (k.queue.empty()) {
+        k.credit = 0;
+        continue;
+      }
+      if (sched_running_ >= SlotCap((RequestClass)c)) {
+        continue;
+      }
+      k.credit += kClassWeight[c];
+      total += kClassWeight[c];
+      if (best < 0 || k.credit > sched_[best].credit) {
+        best = c;
+      }
+    }
+    if (best < 0) {
+      return;
+    }
+    SchedClass& k = sched_[best];
+    k.credit -= total;
+    SchedWaiter* w = k.queue.front();
+    k.queue.pop_front();
+    w->granted = true;
+    sched_running_++;
+    w->ready->Set();
+  }
+}
+
+Engine::Resp Engine::SchedStats() {
+  std::vector<std::pair<std::string, std::string>> kv{{"ok", "1"}, {"slots", std::to_string(cfg_.sched_slots)}};
+  std::lock_guard<std::mutex> lk(sched_mu_);
+  kv.emplace_back("running", std::to_string(sched_running_));
+  for (int c = 0; c < kRequestClasses; c++) {
+    const SchedClass& k = sched_[c];
+    const std::string n = kClassName[c];
+    kv.emplace_back(n + "_weight", std::to_string(kClassWeight[c]));
+    kv.emplace_back(n + "_queued", std::to_string(k.queue.size()));
+    kv.emplace_back(n + "_started", std::to_string(k.started));
+    kv.emplace_back(n + "_shed_full", std::to_string(k.shed_full));
+    kv.emplace_back(n + "_shed_wait", std::to_string(k.shed_wait));
+    kv.emplace_back(n + "_forced", std::to_string(k.forced));
+    kv.emplace_back(n + "_avg_wait_us", std::to_string(k.waited > 0 ? k.wait_us / k.waited : 0));
+    kv.emplace_back(n + "_max_wait_us", std::to_string(k.max_wait_us));
+  }
+  return {200, form_build(kv)};
+}
+
+Engine::Resp Engine::ExecutorStats() {
+  auto kv = exec_->Stats();
+  kv.insert(kv.begin(), {"ok", "1"});
+  return {200, form_build(kv)};
+}
+
+Engine::Resp Engine::LimitStats() {
+  std::vector<std::pair<std::string, std::string>> kv{
+      {"ok", "1"},
+      {"enabled", cfg_.adaptive_limit_enabled ? "1" : "0"},
+      {"count", std::to_string(kLimitedRouteCount)},
+  };
+  for (int i = 0; i < kLimitedRouteCount; i++) {
+    RouteLimit& l = limits_[i];
+    long short_us = 0;
+    long long_us = 0;
+    {
+      std::lock_guard<std::mutex> lk(l.mu);
+      short_us = (long)l.short_rtt_us;
+      long_us = (long)l.long_rtt_us;
+    }
+    const std::string n = std::to_string(i);
+    kv.emplace_back("route" + n, kLimitedRoutes[i].path);
+    kv.emplace_back("limit" + n, std::to_string(l.cap.load(std::memory_order_relaxed)));
+    kv.emplace_back("inflight" + n, std::to_string(l.inflight.load(std::memory_order_relaxed)));
+    kv.emplace_back("admitted" + n, std::to_string(l.admitted.load(std::memory_order_relaxed)));
+    kv.emplace_back("rejected" + n, std::to_string(l.rejected.load(std::memory_order_relaxed)));
+    kv.emplace_back("short_rtt_us" + n, std::to_string(short_us));
+    kv.emplace_back("long_rtt_us" + n, std::to_string(long_us));
+  }
+  return {200, form_build(kv)};
+}
+
+bool Engine::PutAccount(
+    const std::string& id,
+    const std::string& name,
+    const std::string& password_hash,
+    long created_at,
+    bool if_absent,
+    bool* created) {
+  WriteOp op;
+  op.if_absent = if_absent;
+  op.id = id;
+  op.name = name;
+  op.password_hash = password_hash;
+  op.created_at = created_at;
+  const auto started = std::chrono::steady_clock::now();
+  const bool ok = CommitWrite(&op);
+  RecordWrite(kWriteAccount, elapsed_us(started));
+  if (!ok) {
+    return false;
+  }
+  *created = op.created;
+  return true;
+}
+
+bool Engine::PutPost(const Post& p, bool if_absent, bool* created) {
+  WriteOp op;
+  op.is_post = true;
+  op.if_absent = if_absent;
+  op.post = p;
+  const auto started = std::chrono::steady_clock::now();
+  const bool ok = CommitWrite(&op);
+  RecordWrite(kWritePost, elapsed_us(started));
+  if (!ok) {
+    return false;
+  }
+  *created = op.created;
+  return true;
+}
+
+void Engine::RecordWrite(WriteClass c, long us) {
+  auto& l = write_latency_[c];
+  l.count.fetch_add(1, std::memory_order_relaxed);
+  l.total_us.fetch_add(us, std::memory_order_relaxed);
+  long max = l.max_us.load(std::memory_order_relaxed);
+  while (us > max && !l.max_us.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+  }
+}
+
+bool Engine::CommitWrite(WriteOp* op) {
+  // Waits for the group leader, or is the leader and waits on the write (and fsync).
+  Executor::Blocking blocking;
+  std::unique_lock<std::mutex> lk(write_mu_);
+  write_q_.push_back(op);
+  while (!op->done && write_leader_) {
+    write_cv_.wait(lk);
+  }
+  if (op->done) {
+    return op->ok;
+  }
+
+  // Become the leader: take everything queued so far (bounded) and commit it as one group.
+  write_leader_ = true;
+  const size_t max_ops = (size_t)std::max(1, cfg_.write_group_max_ops);
+  std::vector<WriteOp*> group;
+  auto own = std::find(write_q_.begin(), write_q_.end(), op);
+  group.push_back(op);
+  write_q_.erase(own);
+  while (!write_q_.empty() && group.size() < max_ops) {
+    group.push_back(write_q_.front());
+    write_q_.erase(write_q_.begin());
+  }
+  lk.unlock();
+
+  ApplyWriteGroup(group);
+
+  lk.lock();
+  for (auto* w : group) {
+    w->done = true;
+  }
+  write_leader_ = false;
+  write_cv_.notify_all();
+  return op->ok;
+}
+
+void Engine::ApplyWriteGroup(const std::vector<WriteOp*>& group) {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* acc_cf = static_cast<rocksdb::ColumnFamilyHandle*>(acc_cf_);
+  auto* post_cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+  auto* search_cf = static_cast<rocksdb::ColumnFamilyHandle*>(search_cf_);
+
+  std::lock_guard<std::mutex> lk(mu_);
+
+  // Values staged earlier in this group shadow the DB so if-absent checks and
+  // title-index cleanup stay correct when one key appears twice in a group.
+  // Key prefixes are unique across column families; "" marks a staged delete.
+  std::map<std::string, std::string> staged;
+  auto lookup = [&](rocksdb::ColumnFamilyHandle* cf, const std::string& key, std::string* value) {
+    auto it = staged.find(key);
+    if (it != staged.end()) {
+      if (it->second.empty()) {
+        return rocksdb::Status::NotFound();
+      }
+      *value = it->second;
+      return rocksdb::Status::OK();
+    }
+    return db->Get(rocksdb::ReadOptions(), cf, key, value);
+  };
+  auto search_lookup = [&](const std::string& key, std::string* value) {
+    return lookup(search_cf, key, value).ok();
+  };
+  const uint32_t first_doc = search_next_doc_;
 
   rocksdb::WriteBatch batch;
-  batch.Put(cf, key, value);
-  batch.Put(cf, title_index_key(p.created_at, p.id), form_build({
-      {"id", p.id},
-      {"account_id", p.account_id},
-      {"title", p.title},
-      {"created_at", std::to_string(p.created_at)},
-  }));
-  if (had_old) {
-    auto old = form_parse(old_value);
-    const std::string old_id = old["id"].empty() ? p.id : old["id"];
-    long old_created_at = 0;
-    try {
-      old_created_at = std::stol(old["created_at"]);
-    } catch (...) {
-      old_created_at = 0;
+  std::vector<WriteOp*> written;
+  for (auto* op : group) {
+    op->ok = false;
+    op->created = false;
+
+    if (!op->is_post) {
+      std::string key = "a:" + op->id;
+      if (op->if_absent) {
+        std::string ex;
+        auto st = lookup(acc_cf, key, &ex);
+        if (st.ok()) {
+          op->ok = true;
+          continue;
+        }
+        if (!st.IsNotFound()) {
+          continue;
+        }
+      }
+
+      std::string value = form_build({
+          {"id", op->id},
+          {"name", op->name},
+          {"password_hash", op->password_hash},
+          {"created_at", std::to_string(op->created_at)},
+      });
+      batch.Put(acc_cf, key, value);
+      staged[key] = std::move(value);
+      written.push_back(op);
+      continue;
+    }
+
+    const Post& p = op->post;
+    std::string key = "p:" + p.id;
+    std::string old_value;
+    bool had_old = false;
+
+    if (op->if_absent) {
+      std::string ex;
+      auto st = lookup(post_cf, key, &ex);
+      if (st.ok()) {
+        op->ok = true;
+        continue;
+      }
+      if (!st.IsNotFound()) {
+        continue;
+      }
+    } else {
+      auto st = lookup(post_cf, key, &old_value);
+      if (st.ok()) {
+        had_old = true;
+      } else if (!st.IsNotFound()) {
+        continue;
+      }
+    }
+
+    std::string value = form_build({
+        {"id", p.id},
+        {"account_id", p.account_id},
+        {"title", p.title},
+        {"content", p.content},
+        {"created_at", std::to_string(p.created_at)},
+    });
+
+    const std::string summary = post_summary(p.id, p.account_id, p.title, p.created_at);
+    batch.Put(post_cf, key, value);
+    batch.Put(post_cf, title_index_key(p.created_at, p.id), summary);
+    if (!p.account_id.empty()) {
+      batch.Put(post_cf, account_index_key(p.account_id, p.created_at, p.id), summary);
+    }
+    if (had_old) {
+      stage_stale_post_rows(&batch, post_cf, old_value, p.id, p.account_id, p.created_at);
+    }
+    stage_search_doc(&batch, search_cf, search_lookup, &staged, &search_next_doc_, p.id, p.title, p.created_at, summary);
+    staged[key] = std::move(value);
+    written.push_back(op);
+  }
+
+  if (written.empty()) {
+    return;
+  }
+  if (search_next_doc_ != first_doc) {
+    batch.Put(search_cf, kSearchNextDocKey, std::to_string(search_next_doc_));
+  }
+  // One fsync covers every account in the group; post-only groups are left
+  // to WalSyncLoop (bounded by wal_sync_interval_ms) or /internal/wal/sync.
+  rocksdb::WriteOptions wo;
+  wo.sync = cfg_.account_sync &&
+      std::any_of(written.begin(), written.end(), [](const WriteOp* op) { return !op->is_post; });
+  if (!db->Write(wo, &batch).ok()) {
+    // Doc numbers handed out for a failed batch are simply never used.
+    return;
+  }
+  for (auto* op : written) {
+    op->ok = true;
+    op->created = true;
+  }
+}
+
+bool Engine::ReadAccount(
+    const std::string& id,
+    std::string* name,
+    std::string* password_hash,
+    long* created_at) {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(acc_cf_);
+
+  std::string value;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!db->Get(rocksdb::ReadOptions(), cf, "a:" + id, &value).ok()) {
+      return false;
+    }
+  }
+
+  auto f = form_parse(value);
+  if (f["id"].empty()) {
+    return false;
+  }
+
+  *name = f["name"];
+  *password_hash = f["password_hash"];
+  try {
+    *created_at = std::stol(f["created_at"]);
+  } catch (...) {
+    *created_at = 0;
+  }
+  return true;
+}
+
+bool Engine::ReadPost(const std::string& id, Post* out) {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+
+  std::string value;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    if (!db->Get(rocksdb::ReadOptions(), cf, "p:" + id, &value).ok()) {
+      return false;
+    }
+  }
+
+  auto f = form_parse(value);
+  out->id = f["id"];
+  out->account_id = f["account_id"];
+  out->title = f["title"];
+  out->content = f["content"];
+  try {
+    out->created_at = std::stol(f["created_at"]);
+  } catch (...) {
+    out->created_at = 0;
+  }
+  return !out->id.empty();
+}
+
+Engine::Summaries Engine::LocalTitles(int limit, bool* degraded) {
+  Summaries items(RequestArena::Current());
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+  if (degraded) {
+    *degraded = false;
+  }
+
+  FormView f;
+  auto add = [&](const rocksdb::Slice& value) {
+    f.Parse(std::string_view(value.data(), value.size()));
+    const std::string_view id = f.Get("id");
+    if (id.empty()) {
+      return false;
+    }
+    auto& p = items.emplace_back();
+    p.id.assign(id);
+    p.account_id.assign(f.Get("account_id"));
+    p.title.assign(f.Get("title"));
+    if (!to_long(f.Get("created_at"), &p.created_at)) {
+      p.created_at = 0;
+    }
+    return true;
+  };
+
+  std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(rocksdb::ReadOptions(), cf));
+  for (it->Seek("t:"); it->Valid(); it->Next()) {
+    if (!it->key().starts_with("t:")) {
+      break;
+    }
+    if (add(it->value()) && limit > 0 && (int)items.size() >= limit) {
+      break;
+    }
+  }
+
+  if (index_ready_.load(std::memory_order_acquire)) {
+    return items;
+  }
+
+  // The background builder has not covered every p: row yet. Serve what the
+  // index has plus a bounded reverse scan of p: (generated ids start with the
+  // creation time and sort after the older form, so the tail of the range is
+  // roughly the newest posts).
+  if (degraded) {
+    *degraded = true;
+  }
+  const int scan_limit = limit > 0 ? limit : std::max(1, cfg_.title_backfill_chunk);
+  rocksdb::ReadOptions ro;
+  ro.fill_cache = false;
+  std::unique_ptr<rocksdb::Iterator> pit(db->NewIterator(ro, cf));
+  int scanned = 0;
+  for (pit->SeekForPrev("p;"); pit->Valid() && scanned < scan_limit; pit->Prev()) {
+    if (!pit->key().starts_with("p:")) {
+      break;
+    }
+    if (add(pit->value())) {
+      scanned++;
+    }
+  }
+
+  finish_rows(&items, limit);
+  return items;
+}
+
+// Touches the newest t: rows, their p: rows and the author's a:/h: rows so the
+// first /post/titles, /post/get and by_account calls after a restart hit the
+// block cache. Opening those SSTs also loads (and pins) L0 index/filter blocks.
+// Stops at warmup_budget_ms; the node reports ready=0 until this returns.
+void Engine::Warmup() {
+  const auto started = std::chrono::steady_clock::now();
+  const auto deadline = started + std::chrono::milliseconds(cfg_.warmup_budget_ms);
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* acc_cf = static_cast<rocksdb::ColumnFamilyHandle*>(acc_cf_);
+  auto* post_cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+
+  rocksdb::ReadOptions ro;
+  std::set<std::string> accounts;
+  std::string value;
+  long titles = 0;
+  std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(ro, post_cf));
+  for (it->Seek("t:"); it->Valid() && titles < cfg_.warmup_titles; it->Next()) {
+    if (!it->key().starts_with("t:")) {
+      break;
+    }
+    if (stop_ || std::chrono::steady_clock::now() >= deadline) {
+      break;
+    }
+    titles++;
+    auto f = form_parse(it->value().ToString());
+    if (!f["id"].empty()) {
+      db->Get(ro, post_cf, "p:" + f["id"], &value);
+    }
+    const std::string& acc = f["account_id"];
+    if (!acc.empty() && accounts.insert(acc).second) {
+      db->Get(ro, acc_cf, "a:" + acc, &value);
+      db->Get(ro, acc_cf, "h:" + acc, &value);
+    }
+  }
+
+  const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+      std::chrono::steady_clock::now() - started).count();
+  std::cout << "[kvs] warmup titles=" << titles
+            << " accounts=" << accounts.size()
+            << " elapsed_ms=" << elapsed
+            << std::endl;
+  warm_.store(true, std::memory_order_release);
+}
+
+// Marks every doc number without a d: row dead, so postings left behind by an
+// earlier run (retention drops, retitled posts) are pruned too. The iterator is
+// opened under mu_: no group commit is half-written, and docs a bulk ingest
+// has reserved but not written yet are skipped.
+void Engine::ScanDeadDocs() {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(search_cf_);
+  uint32_t limit = 0;
+  std::vector<std::pair<uint32_t, uint32_t>> pending;
+  std::unique_ptr<rocksdb::Iterator> it;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    limit = search_next_doc_;
+    pending = bulk_docs_;
+    rocksdb::ReadOptions ro;
+    ro.fill_cache = false;
+    it.reset(db->NewIterator(ro, cf));
+  }
+
+  std::vector<bool> live(limit + 1, false);
+  for (it->Seek("d:"); it->Valid() && it->key().starts_with("d:") && !stop_; it->Next()) {
+    uint32_t doc = 0;
+    for (size_t i = 2; i < it->key().size(); i++) {
+      doc = doc * 10 + (uint32_t)(it->key()[i] - '0');
     }
-    if (old_id != p.id || old_created_at != p.created_at) {
-      batch.Delete(cf, title_index_key(old_created_at, old_id));
+    if (doc <= limit) {
+      live[doc] = true;
+    }
+  }
+  if (stop_ || !it->status().ok()) {
+    return;
+  }
+  long dead = 0;
+  for (uint32_t doc = 1; doc <= limit; doc++) {
+    const bool reserved = std::any_of(pending.begin(), pending.end(), [&](const std::pair<uint32_t, uint32_t>& r) {
+      return doc >= r.first && doc <= r.second;
+    });
+    if (!live[doc] && !reserved) {
+      dead_docs_.Add(doc);
+      dead++;
     }
   }
+  std::cout << "[kvs] search dead docs=" << dead << " of " << limit << std::endl;
+}
 
-  if (!db->Write(rocksdb::WriteOptions(), &batch).ok()) {
+// reset only takes effect for the caller that wins the compare_exchange, so
+// it can never wipe the cursor under a backfill that is already running.
+bool Engine::StartTitleBackfill(bool reset) {
+  std::lock_guard<std::mutex> lk(index_mu_);
+  bool expected = false;
+  if (!index_building_.compare_exchange_strong(expected, true)) {
     return false;
   }
-  *created = true;
+  if (reset) {
+    index_ready_ = false;
+  }
+  exec_->Post([this, reset]() { BuildTitleIndex(reset); });
   return true;
 }
 
-bool Engine::ReadAccount(
-    const std::string& id,
-    std::string* name,
-    std::string* password_hash,
-    long* created_at) {
+void Engine::BuildTitleIndex(bool reset) {
   auto* db = static_cast<rocksdb::DB*>(db_);
-  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(acc_cf_);
+  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+  auto* def_cf = static_cast<rocksdb::ColumnFamilyHandle*>(def_cf_);
+  auto* search_cf = static_cast<rocksdb::ColumnFamilyHandle*>(search_cf_);
+  auto search_lookup = [&](const std::string& key, std::string* value) {
+    return db->Get(rocksdb::ReadOptions(), search_cf, key, value).ok();
+  };
+  const size_t chunk = (size_t)std::max(1, cfg_.title_backfill_chunk);
+  const int rows_per_sec = cfg_.title_backfill_rows_per_sec;
+
+  // The checkpoint holds the last p: key indexed, so a restart resumes where it stopped.
+  std::string cursor;
+  if (reset) {
+    if (!db->Delete(rocksdb::WriteOptions(), def_cf, kIndexBackfillKey).ok()) {
+      index_building_ = false;
+      return;
+    }
+  } else if (!db->Get(rocksdb::ReadOptions(), def_cf, kIndexBackfillKey, &cursor).ok() || cursor.rfind("done", 0) == 0) {
+    cursor.clear();
+  }
 
-  std::string value;
+  // Decimal t: keys sort ahead of every binary one, so they go first and the
+  // pass restarts from the top: a cursor left by an older build only
+  // covered rows that were indexed under the old schema.
   {
-    std::lock_guard<std::mutex> lk(mu_);
-    if (!db->Get(rocksdb::ReadOptions(), cf, "a:" + id, &value).ok()) {
-      return false;
+    std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(rocksdb::ReadOptions(), cf));
+    it->Seek(kLegacyTitleBegin);
+    if (it->Valid() && it->key().compare(kLegacyTitleEnd) < 0) {
+      rocksdb::WriteBatch batch;
+      batch.DeleteRange(cf, kLegacyTitleBegin, kLegacyTitleEnd);
+      batch.Delete(def_cf, kIndexBackfillKey);
+      if (!db->Write(rocksdb::WriteOptions(), &batch).ok()) {
+        index_building_ = false;
+        return;
+      }
+      cursor.clear();
+      std::cout << "[kvs] title index: dropped decimal t: keys, rebuilding" << std::endl;
     }
   }
 
-  auto f = form_parse(value);
-  if (f["id"].empty()) {
-    return false;
+  const auto started = std::chrono::steady_clock::now();
+  long rows = 0;
+  bool finished = false;
+  while (!stop_ && !finished) {
+    const auto chunk_started = std::chrono::steady_clock::now();
+    size_t n = 0;
+    {
+      // Each chunk is read and written under mu_ so a concurrent PutPost cannot
+      // replace a post between our read and the index write; chunks keep it short.
+      std::lock_guard<std::mutex> lk(mu_);
+      rocksdb::ReadOptions ro;
+      ro.fill_cache = false;
+      ro.readahead_size = 2 * 1024 * 1024;
+      rocksdb::Slice upper("p;");
+      ro.iterate_upper_bound = &upper;
+      std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(ro, cf));
+
+      it->Seek(cursor.empty() ? "p:" : cursor);
+      if (!cursor.empty() && it->Valid() && it->key() == rocksdb::Slice(cursor)) {
+        it->Next();
+      }
+
+      rocksdb::WriteBatch batch;
+      for (; it->Valid() && n < chunk; it->Next()) {
+        if (!it->key().starts_with("p:")) {
+          break;
+        }
+        auto f = form_parse(it->value().ToString());
+        cursor = it->key().ToString();
+        n++;
+        if (f["id"].empty()) {
+          continue;
+        }
+        long created_at = 0;
+        try {
+          created_at = std::stol(f["created_at"]);
+        } catch (...) {
+          created_at = 0;
+        }
+        const std::string summary = post_summary(f["id"], f["account_id"], f["title"], created_at);
+        batch.Put(cf, title_index_key(created_at, f["id"]), summary);
+        if (!f["account_id"].empty()) {
+          batch.Put(cf, account_index_key(f["account_id"], created_at, f["id"]), summary);
+        }
+        stage_search_doc(&batch, search_cf, search_lookup, nullptr, &search_next_doc_, f["id"], f["title"], created_at, summary);
+      }
+      if (!it->status().ok()) {
+        break;
+      }
+
+      finished = n < chunk;
+      batch.Put(search_cf, kSearchNextDocKey, std::to_string(search_next_doc_));
+      batch.Put(def_cf, kIndexBackfillKey, finished ? std::string(kIndexBackfillDone) : cursor);
+      // Index rows can always be rebuilt from p:, so they may skip the WAL; the
+      // cursor rides in the same batch and atomic_flush keeps the two together.
+      rocksdb::WriteOptions wo;
+      wo.disableWAL = cfg_.repair_disable_wal;
+      const auto write_started = std::chrono::steady_clock::now();
+      const bool written = db->Write(wo, &batch).ok();
+      RecordWrite(kWriteRepair, elapsed_us(write_started));
+      if (!written) {
+        break;
+      }
+    }
+    rows += (long)n;
+
+    if (!finished && rows_per_sec > 0) {
+      const auto budget = std::chrono::microseconds((long long)n * 1000000 / rows_per_sec);
+      const auto spent = std::chrono::steady_clock::now() - chunk_started;
+      if (spent < budget) {
+        Executor::Blocking blocking;
+        std::unique_lock<std::mutex> lk(index_mu_);
+        index_cv_.wait_for(lk, budget - spent, [&]() { return stop_.load(); });
+      }
+    }
   }
 
-  *name = f["name"];
-  *password_hash = f["password_hash"];
-  try {
-    *created_at = std::stol(f["created_at"]);
-  } catch (...) {
-    *created_at = 0;
+  if (finished) {
+    index_ready_.store(true, std::memory_order_release);
+    std::cout << "[kvs] title index backfill done rows=" << rows
+              << " ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count()
+              << std::endl;
   }
-  return true;
+  index_building_ = false;
 }
 
-bool Engine::ReadPost(const std::string& id, Post* out) {
+Engine::Summaries Engine::LocalByAccount(const std::string& account_id, const std::string& cursor, int limit) {
+  Summaries items(RequestArena::Current());
   auto* db = static_cast<rocksdb::DB*>(db_);
   auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
 
-  std::string value;
-  {
-    std::lock_guard<std::mutex> lk(mu_);
-    if (!db->Get(rocksdb::ReadOptions(), cf, "p:" + id, &value).ok()) {
-      return false;
+  const std::string prefix = account_index_prefix(account_id);
+  const std::string start = prefix + cursor;
+  std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(rocksdb::ReadOptions(), cf));
+  it->Seek(start);
+  if (!cursor.empty() && it->Valid() && it->key() == rocksdb::Slice(start)) {
+    it->Next();
+  }
+  FormView f;
+  for (; it->Valid(); it->Next()) {
+    if (!it->key().starts_with(prefix)) {
+      break;
+    }
+    f.Parse(std::string_view(it->value().data(), it->value().size()));
+    // Account ids may contain ':', so another account's rows can share the prefix.
+    if (f.Get("id").empty() || f.Get("account_id") != account_id) {
+      continue;
+    }
+    auto& p = items.emplace_back();
+    p.id.assign(f.Get("id"));
+    p.account_id.assign(account_id);
+    p.title.assign(f.Get("title"));
+    if (!to_long(f.Get("created_at"), &p.created_at)) {
+      p.created_at = 0;
+    }
+    if (limit > 0 && (int)items.size() >= limit) {
+      break;
     }
   }
+  return items;
+}
 
-  auto f = form_parse(value);
-  out->id = f["id"];
-  out->account_id = f["account_id"];
-  out->title = f["title"];
-  out->content = f["content"];
-  try {
-    out->created_at = std::stol(f["created_at"]);
-  } catch (...) {
-    out->created_at = 0;
+Engine::Summaries Engine::LocalSearch(const std::string& q, int limit) {
+  Summaries items(RequestArena::Current());
+  const auto tokens = title_tokens(q);
+  const auto words = title_words(q);
+  if (tokens.empty()) {
+    return items;
   }
-  return !out->id.empty();
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(search_cf_);
+
+  std::vector<std::string> keys;
+  for (const auto& t : tokens) {
+    keys.push_back("s:" + t);
+  }
+  // async_io: MultiGet reads a batch's blocks from different files in
+  // parallel instead of one after another.
+  rocksdb::ReadOptions ro;
+  ro.async_io = true;
+  std::vector<rocksdb::Slice> key_slices(keys.begin(), keys.end());
+  std::vector<rocksdb::PinnableSlice> values(keys.size());
+  std::vector<rocksdb::Status> statuses(keys.size());
+  db->MultiGet(ro, cf, keys.size(), key_slices.data(), values.data(), statuses.data());
+
+  std::vector<std::vector<uint32_t>> lists(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (!statuses[i].ok() || !decode_postings(values[i], &lists[i]) || lists[i].empty()) {
+      return items;
+    }
+  }
+  std::sort(lists.begin(), lists.end(), [](const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+    return a.size() < b.size();
+  });
+  std::vector<uint32_t> docs = std::move(lists[0]);
+  for (size_t i = 1; i < lists.size() && !docs.empty(); i++) {
+    std::vector<uint32_t> next(docs.size());
+    next.resize(intersect_postings(docs.data(), docs.size(), lists[i].data(), lists[i].size(), next.data()));
+    docs.swap(next);
+  }
+
+  // Newer posts have larger doc numbers. Bigram hits are candidates only:
+  // dead docs are skipped and every query word must appear in the title.
+  const size_t batch = 32;
+  FormView f;
+  for (size_t end = docs.size(); end > 0 && (limit <= 0 || (int)items.size() < limit);) {
+    const size_t begin = end > batch ? end - batch : 0;
+    std::vector<std::string> doc_keys;
+    for (size_t i = end; i > begin; i--) {
+      doc_keys.push_back(search_doc_key(docs[i - 1]));
+    }
+    std::vector<rocksdb::Slice> doc_slices(doc_keys.begin(), doc_keys.end());
+    std::vector<rocksdb::PinnableSlice> doc_values(doc_keys.size());
+    std::vector<rocksdb::Status> doc_statuses(doc_keys.size());
+    db->MultiGet(ro, cf, doc_keys.size(), doc_slices.data(), doc_values.data(), doc_statuses.data());
+
+    for (size_t i = 0; i < doc_keys.size(); i++) {
+      if (!doc_statuses[i].ok()) {
+        continue;
+      }
+      f.Parse(std::string_view(doc_values[i].data(), doc_values[i].size()));
+      const auto title_lc = title_words(std::string(f.Get("title")));
+      bool match = !f.Get("id").empty();
+      for (size_t w = 0; match && w < words.size(); w++) {
+        match = std::any_of(title_lc.begin(), title_lc.end(), [&](const std::string& t) {
+          return t.find(words[w]) != std::string::npos;
+        });
+      }
+      if (!match) {
+        continue;
+      }
+      auto& p = items.emplace_back();
+      p.id.assign(f.Get("id"));
+      p.account_id.assign(f.Get("account_id"));
+      p.title.assign(f.Get("title"));
+      if (!to_long(f.Get("created_at"), &p.created_at)) {
+        p.created_at = 0;
+      }
+      if (limit > 0 && (int)items.size() >= limit) {
+        break;
+      }
+    }
+    end = begin;
+  }
+  return items;
 }
 
-std::vector<Engine::Post> Engine::LocalTitles(int limit) {
-  std::vector<Post> indexed;
-  std::vector<Post> scanned;
+std::vector<std::string> Engine::ReadHolders(const std::string& account_id, bool* trusted) {
   auto* db = static_cast<rocksdb::DB*>(db_);
-  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(acc_cf_);
+  *trusted = false;
+  std::string value;
+  if (!db->Get(rocksdb::ReadOptions(), cf, "h:" + account_id, &value).ok()) {
+    return {};
+  }
+  auto h = parse_holders(value);
+  *trusted = h.verified_at > 0 && now_ms() - h.verified_at < kHolderHintTrustMs;
+  return h.nodes;
+}
+
+// verified_at > 0 records a completed holder check that started at that time;
+// the node list is only ever extended, so a check racing a broadcast keeps both.
+bool Engine::MergeHolders(const std::string& account_id, const std::vector<std::string>& node_ids, bool* changed, long verified_at) {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* cf = static_cast<rocksdb::ColumnFamilyHandle*>(acc_cf_);
+  *changed = false;
 
   std::lock_guard<std::mutex> lk(mu_);
-  std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(rocksdb::ReadOptions(), cf));
+  std::string value;
+  auto st = db->Get(rocksdb::ReadOptions(), cf, "h:" + account_id, &value);
+  if (!st.ok() && !st.IsNotFound()) {
+    return false;
+  }
+  auto h = parse_holders(value);
+  *changed = merge_holder_ids(&h, node_ids);
+  const bool verified = verified_at > h.verified_at;
+  if (verified) {
+    h.verified_at = verified_at;
+  }
+  if (!*changed && !verified) {
+    return true;
+  }
+  return db->Put(rocksdb::WriteOptions(), cf, "h:" + account_id, holders_value(h)).ok();
+}
 
-  for (it->Seek("t:"); it->Valid(); it->Next()) {
-    std::string key = it->key().ToString();
-    if (key.rfind("t:", 0) != 0) {
-      break;
+Engine::Liveness* Engine::LivenessOf(const NodeInfo& n) {
+  if (n.slot < 0 || (size_t)n.slot >= nodes_.size()) {
+    return nullptr;
+  }
+  return &live_[n.slot];
+}
+
+bool Engine::LookupAliveMemo(const NodeInfo& n, bool* alive) {
+  Liveness* l = LivenessOf(n);
+  if (!l) {
+    return false;
+  }
+  const long memo = l->memo.load(std::memory_order_relaxed);
+  if ((memo >> 1) <= now_ms()) {
+    return false;
+  }
+  *alive = (memo & 1) != 0;
+  return true;
+}
+
+void Engine::StoreAliveMemo(const NodeInfo& n, bool alive) {
+  Liveness* l = LivenessOf(n);
+  if (!l) {
+    return;
+  }
+  // Past the request's deadline Call() gives up without asking the peer.
+  const long deadline_ms = RequestDeadline::At();
+  if (!alive && deadline_ms > 0 && now_ms() >= deadline_ms) {
+    return;
+  }
+  const int ttl_ms = alive ? std::max(0, cfg_.alive_cache_ms) : std::max(0, cfg_.dead_cache_ms);
+  // A zero TTL still overwrites, so an older verdict is not served past this one.
+  l->memo.store(ttl_ms > 0 ? (now_ms() + ttl_ms) << 1 | (alive ? 1 : 0) : 0, std::memory_order_relaxed);
+}
+
+bool Engine::Alive(const NodeInfo& n) {
+  if (cfg_.single_node) {
+    return true;
+  }
+  if (n.id == cfg_.node_id) {
+    return true;
+  }
+  // Open breaker (failures or ejected as an outlier): down until it may be probed.
+  if (Liveness* l = LivenessOf(n)) {
+    const int state = l->breaker.load(std::memory_order_acquire);
+    if (state == kBreakerHalfOpen || (state == kBreakerOpen && now_ms() < l->open_until.load(std::memory_order_relaxed))) {
+      return false;
     }
-    auto f = form_parse(it->value().ToString());
-    Post p;
-    p.id = f["id"];
-    p.account_id = f["account_id"];
-    p.title = f["title"];
-    try {
-      p.created_at = std::stol(f["created_at"]);
-    } catch (...) {
-      p.created_at = 0;
+  }
+
+  bool cached = false;
+  if (LookupAliveMemo(n, &cached)) {
+    return cached;
+  }
+
+  int status = 0;
+  std::string out;
+  const int ping_timeout_ms = cfg_.alive_probe_timeout_ms > 0 ? cfg_.alive_probe_timeout_ms : cfg_.rpc_timeout_ms;
+  bool ok = Call(n, "/internal/ping", "", &status, &out, ping_timeout_ms) && status == 200;
+  if (ok) {
+    // A warming peer is up but cold; route around it until it reports ready.
+    auto f = form_parse(out);
+    ok = f["ok"] == "1" && f["ready"] != "0";
+  }
+  StoreAliveMemo(n, ok);
+  return ok;
+}
+
+std::vector<NodeInfo> Engine::PostOwners(const std::string& id, bool alive_only) {
+  if (cfg_.single_node) {
+    return std::vector<NodeInfo>{{cfg_.node_id, "127.0.0.1", cfg_.port}};
+  }
+  std::vector<NodeInfo> nodes = nodes_;
+  std::sort(nodes.begin(), nodes.end(), [&](const NodeInfo& a, const NodeInfo& b) {
+    auto ha = h64(id + "|" + a.id);
+    auto hb = h64(id + "|" + b.id);
+    if (ha == hb) {
+      return a.id < b.id;
     }
-    if (!p.id.empty()) {
-      indexed.push_back(p);
-      if (limit > 0 && (int)indexed.size() >= limit) {
-        return indexed;
-      }
+    return ha > hb;
+  });
+
+  if (!alive_only) {
+    return nodes;
+  }
+
+  if (nodes.empty()) {
+    return {};
+  }
+
+  std::vector<int> up(nodes.size(), 0);
+  exec_->ParallelFor(nodes.size(), [&](size_t i) {
+    RequestDeadline request_deadline(0);
+    up[i] = Alive(nodes[i]) ? 1 : 0;
+  });
+
+  std::vector<NodeInfo> alive;
+  alive.reserve(nodes.size());
+  for (size_t i = 0; i < nodes.size(); i++) {
+    if (up[i] != 0) {
+      alive.push_back(nodes[i]);
     }
   }
+  return alive;
+}
+
+bool Engine::Call(
+    const NodeInfo& n,
+    const std::string& path,
+    const std::string& body,
+    int* status,
+    std::string* out,
+    int timeout_ms,
+    CallCancel* cancel) {
+  int call_timeout_ms = 0;
+  Liveness* l = nullptr;
+  if (!PrepareCall(n, timeout_ms, &call_timeout_ms, &l, status, out)) {
+    return false;
+  }
+  const auto started = std::chrono::steady_clock::now();
+  auto r = post(n.host, n.port, path, body, call_timeout_ms, RequestDeadline::At(), cancel);
+  FinishCall(l, cancel, r.s, elapsed_us(started));
+  *status = r.s;
+  *out = std::move(r.b);
+  return r.s > 0;
+}
 
-  if (!indexed.empty()) {
-    return indexed;
+// Call() for coroutines: the caller is parked on the event loop, not a worker.
+Task<bool> Engine::CallAsync(
+    NodeInfo n,
+    std::string path,
+    std::string body,
+    int* status,
+    std::string* out,
+    int timeout_ms,
+    CallCancel* cancel) {
+  int call_timeout_ms = 0;
+  Liveness* l = nullptr;
+  if (!PrepareCall(n, timeout_ms, &call_timeout_ms, &l, status, out)) {
+    co_return false;
   }
+  const auto started = std::chrono::steady_clock::now();
+  auto r = co_await async_post(loop_.get(), std::move(n), std::move(path), std::move(body), call_timeout_ms,
+                               RequestDeadline::At(), cancel);
+  FinishCall(l, cancel, r.s, elapsed_us(started));
+  *status = r.s;
+  *out = std::move(r.b);
+  co_return r.s > 0;
+}
 
-  for (it->Seek("p:"); it->Valid(); it->Next()) {
-    std::string key = it->key().ToString();
-    if (key.rfind("p:", 0) != 0) {
-      break;
+// Timeout clamped to the request's deadline, and the peer's breaker. False
+// means nothing goes out; *status and *out already say so.
+bool Engine::PrepareCall(const NodeInfo& n, int timeout_ms, int* call_timeout_ms, Liveness** l, int* status, std::string* out) {
+  *call_timeout_ms = timeout_ms > 0 ? timeout_ms : cfg_.rpc_timeout_ms;
+  if (*call_timeout_ms <= 0) {
+    *call_timeout_ms = 450;
+  }
+  const long deadline_ms = RequestDeadline::At();
+  if (deadline_ms > 0) {
+    const long left_ms = deadline_ms - now_ms();
+    if (left_ms <= 0) {
+      // Out of time before sending: not the peer's failure, so not recorded.
+      *status = 0;
+      out->clear();
+      return false;
     }
-    auto f = form_parse(it->value().ToString());
-    Post p;
-    p.id = f["id"];
-    p.account_id = f["account_id"];
-    p.title = f["title"];
-    try {
-      p.created_at = std::stol(f["created_at"]);
-    } catch (...) {
-      p.created_at = 0;
+    *call_timeout_ms = (int)std::min<long>(*call_timeout_ms, left_ms);
+  }
+  *l = LivenessOf(n);
+  if (*l && !AdmitCall(*l)) {
+    // Breaker open: fail fast so the caller moves on to another replica.
+    *status = 0;
+    out->clear();
+    return false;
+  }
+  return true;
+}
+
+void Engine::FinishCall(Liveness* l, CallCancel* cancel, int status, long us) {
+  // A cancelled hedge says nothing about the peer; if it was the half-open
+  // probe, hand the probe to the next caller.
+  if (l && cancel && cancel->Cancelled()) {
+    int state = kBreakerHalfOpen;
+    l->breaker.compare_exchange_strong(state, kBreakerOpen, std::memory_order_acq_rel);
+  } else if (l) {
+    RecordCall(l, status, us);
+  }
+}
+
+// Closed: every call goes out. Open: none until open_until, then the first
+// caller flips it to half-open and is the probe; the probe's result closes
+// or re-opens it (RecordCall).
+bool Engine::AdmitCall(Liveness* l) {
+  int state = l->breaker.load(std::memory_order_acquire);
+  if (state == kBreakerClosed) {
+    return true;
+  }
+  if (state == kBreakerHalfOpen || now_ms() < l->open_until.load(std::memory_order_relaxed)) {
+    return false;
+  }
+  return l->breaker.compare_exchange_strong(state, kBreakerHalfOpen, std::memory_order_acq_rel);
+}
+
+// Transport errors, 5xx and 429 (the peer shedding load) count against the
+// peer, so a shedding peer trips its breaker and callers back off; 503 is a
+// warming node turning reads away on purpose, which Alive() already routes
+// around, and 504 is our own deadline running out there.
+void Engine::RecordCall(Liveness* l, int status, long us) {
+  const bool ok = status > 0 && ((status < 500 && status != 429) || status == 503 || status == 504);
+  if (status > 0) {
+    l->latency.Add(us);
+    // Lossy under contention (a racing sample may be dropped) but never waits.
+    const long prev = l->ewma_us.load(std::memory_order_relaxed);
+    l->ewma_us.store(prev == 0 ? us : prev + (us - prev) / 8, std::memory_order_relaxed);
+  }
+
+  if (ok) {
+    l->failures.store(0, std::memory_order_relaxed);
+    int state = kBreakerHalfOpen;
+    l->breaker.compare_exchange_strong(state, kBreakerClosed, std::memory_order_acq_rel);
+    EjectOutliers();
+    return;
+  }
+
+  const int failures = l->failures.fetch_add(1, std::memory_order_relaxed) + 1;
+  const int state = l->breaker.load(std::memory_order_acquire);
+  if (state == kBreakerHalfOpen ||
+      (state == kBreakerClosed && cfg_.peer_breaker_failures > 0 && failures >= cfg_.peer_breaker_failures)) {
+    TripBreaker(l, std::max(1, cfg_.peer_breaker_open_ms));
+  }
+}
+
+void Engine::TripBreaker(Liveness* l, long open_ms) {
+  l->open_until.store(now_ms() + open_ms, std::memory_order_relaxed);
+  l->breaker.store(kBreakerOpen, std::memory_order_release);
+  l->trips.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Latency outliers: at most once a second, a closed peer whose p99 is both
+// over peer_outlier_min_ms and peer_outlier_factor times the median p99 of
+// the other peers is ejected (breaker opened) for peer_outlier_eject_ms.
+// At most half the peers (at least one) are out at a time, so a cluster-wide
+// slowdown never ejects everything.
+void Engine::EjectOutliers() {
+  constexpr long kEvalEveryMs = 1000;
+  constexpr uint32_t kMinSamples = 50;
+  if (cfg_.peer_outlier_factor <= 0) {
+    return;
+  }
+  const long now = now_ms();
+  long due = outlier_eval_at_.load(std::memory_order_relaxed);
+  if (now < due || !outlier_eval_at_.compare_exchange_strong(due, now + kEvalEveryMs, std::memory_order_relaxed)) {
+    return;
+  }
+
+  std::vector<std::pair<Liveness*, long>> peers;
+  int total = 0;
+  int out = 0;
+  for (const auto& n : nodes_) {
+    if (n.id == cfg_.node_id) {
+      continue;
     }
-    if (!p.id.empty()) {
-      scanned.push_back(p);
+    total++;
+    Liveness* l = &live_[n.slot];
+    if (l->breaker.load(std::memory_order_acquire) != kBreakerClosed) {
+      out++;
+    } else if (l->latency.samples.load(std::memory_order_relaxed) >= kMinSamples) {
+      peers.emplace_back(l, l->latency.Quantile(0.99));
     }
   }
 
-  if (!scanned.empty()) {
-    rocksdb::WriteBatch batch;
-    for (const auto& p : scanned) {
-      batch.Put(cf, title_index_key(p.created_at, p.id), form_build({
-          {"id", p.id},
-          {"account_id", p.account_id},
-          {"title", p.title},
-          {"created_at", std::to_string(p.created_at)},
-      }));
+  const int max_out = std::max(1, total / 2);
+  const long floor_us = (long)std::max(0, cfg_.peer_outlier_min_ms) * 1000;
+  for (size_t i = 0; i < peers.size() && peers.size() >= 2 && out < max_out; i++) {
+    std::vector<long> others;
+    for (size_t j = 0; j < peers.size(); j++) {
+      if (j != i) {
+        others.push_back(peers[j].second);
+      }
     }
-    db->Write(rocksdb::WriteOptions(), &batch);
-  }
-
-  if (limit <= 0) {
-    return scanned;
-  }
-
-  if (scanned.empty()) {
-    return scanned;
+    std::nth_element(others.begin(), others.begin() + others.size() / 2, others.end());
+    const long median = others[others.size() / 2];
+    const long p99 = peers[i].second;
+    if (p99 < floor_us || p99 <= median * cfg_.peer_outlier_factor) {
+      continue;
+    }
+    Liveness* l = peers[i].first;
+    TripBreaker(l, std::max(1, cfg_.peer_outlier_eject_ms));
+    l->ejections.fetch_add(1, std::memory_order_relaxed);
+    // Fresh samples after the probe, or the old tail ejects it again at once.
+    l->latency.Reset();
+    out++;
+    std::cout << "[kvs] peer ejected slot=" << (l - live_.get()) << " p99_us=" << p99 << " median_us=" << median << std::endl;
   }
+}
 
-  std::sort(scanned.begin(), scanned.end(), [](const Post& a, const Post& b) {
-    if (a.created_at == b.created_at) {
-      return a.id > b.id;
+void Engine::LatencyHist::Add(long us) {
+  static_assert(kBuckets == kLatencyBuckets, "latency_bucket() range");
+  buckets[latency_bucket(us)].fetch_add(1, std::memory_order_relaxed);
+  if (samples.fetch_add(1, std::memory_order_relaxed) + 1 == kWindow) {
+    for (auto& b : buckets) {
+      b.store(b.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
     }
-    return a.created_at > b.created_at;
-  });
-  if ((int)scanned.size() > limit) {
-    scanned.resize((size_t)limit);
+    samples.fetch_sub(kWindow / 2, std::memory_order_relaxed);
   }
-  return scanned;
 }
 
-bool Engine::LookupAliveMemo(const NodeInfo& n, bool* alive) {
-  const int alive_ttl_ms = std::max(0, cfg_.alive_cache_ms);
-  const int dead_ttl_ms = std::max(0, cfg_.dead_cache_ms);
-  if (alive_ttl_ms <= 0 && dead_ttl_ms <= 0) {
-    return false;
+long Engine::LatencyHist::Quantile(double q) const {
+  uint64_t total = 0;
+  for (const auto& b : buckets) {
+    total += b.load(std::memory_order_relaxed);
   }
-
-  const auto key = node_key(n);
-  const long now = now_ms();
-  std::lock_guard<std::mutex> lk(alive_mu_);
-  auto it = alive_memo_.find(key);
-  if (it == alive_memo_.end()) {
-    return false;
+  if (total == 0) {
+    return 0;
   }
-  if (it->second.expires_at <= now) {
-    alive_memo_.erase(it);
-    return false;
+  const uint64_t want = std::max<uint64_t>(1, (uint64_t)(q * (double)total + 0.5));
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; i++) {
+    seen += buckets[i].load(std::memory_order_relaxed);
+    if (seen >= want) {
+      return latency_bucket_max(i);
+    }
   }
-  *alive = it->second.alive;
-  return true;
+  return latency_bucket_max(kBuckets - 1);
 }
 
-void Engine::StoreAliveMemo(const NodeInfo& n, bool alive) {
-  const int ttl_ms = alive ? std::max(0, cfg_.alive_cache_ms) : std::max(0, cfg_.dead_cache_ms);
-  if (ttl_ms <= 0) {
-    return;
+void Engine::LatencyHist::Reset() {
+  for (auto& b : buckets) {
+    b.store(0, std::memory_order_relaxed);
   }
-
-  const auto key = node_key(n);
-  std::lock_guard<std::mutex> lk(alive_mu_);
-  alive_memo_[key] = AliveMemo{alive, now_ms() + ttl_ms};
+  samples.store(0, std::memory_order_relaxed);
 }
 
-bool Engine::Alive(const NodeInfo& n) {
-  if (cfg_.single_node) {
-    return true;
+// The first caller for a key runs work; callers arriving while it runs wait
+// for its Resp instead of repeating the fan-out. The entry leaves the table
+// before the result is published, so a caller after that starts fresh. A
+// waiter that runs out of wait_ms does the work itself rather than hang on
+// a stuck leader.
+Task<Engine::Resp> Engine::Coalesced(std::string key, int wait_ms, std::function<Task<Resp>()> work) {
+  std::shared_ptr<Flight> flight;
+  bool leader = false;
+  {
+    std::lock_guard<std::mutex> lk(flights_mu_);
+    auto& slot = flights_[key];
+    if (!slot) {
+      slot = std::make_shared<Flight>();
+      slot->done.reset(new Event(loop_.get()));
+      leader = true;
+    }
+    flight = slot;
   }
-  if (n.id == cfg_.node_id) {
-    return true;
+
+  if (!leader) {
+    coalesced_.fetch_add(1, std::memory_order_relaxed);
+    const long deadline_ms = RequestDeadline::At();
+    if (deadline_ms > 0) {
+      wait_ms = (int)std::min<long>(wait_ms, deadline_ms - now_ms());
+    }
+    const auto until = EventLoop::Clock::now() + std::chrono::milliseconds(std::max(1, wait_ms));
+    // A leader that ran out of its own deadline (504, or a result cut short
+    // by it) has nothing to share.
+    const bool shared = co_await flight->done->Wait(until);
+    if (shared && flight->resp.status != 504 && !flight->resp.partial) {
+      co_return flight->resp;
+    }
+    co_return co_await work();
   }
 
-  bool cached = false;
-  if (LookupAliveMemo(n, &cached)) {
-    return cached;
+  Resp resp = co_await work();
+  {
+    std::lock_guard<std::mutex> lk(flights_mu_);
+    flights_.erase(key);
   }
+  // resp is written before Set() and read only after a Wait() that saw it.
+  flight->resp = resp;
+  flight->done->Set();
+  co_return resp;
+}
 
-  int status = 0;
-  std::string out;
-  const int ping_timeout_ms = cfg_.alive_probe_timeout_ms > 0 ? cfg_.alive_probe_timeout_ms : cfg_.rpc_timeout_ms;
-  const bool ok = Call(n, "/internal/ping", "", &status, &out, ping_timeout_ms) &&
-      status == 200 &&
-      form_parse(out)["ok"] == "1";
-  StoreAliveMemo(n, ok);
-  return ok;
+// Closed breakers first, then lower EWMA; a peer with no samples yet ranks
+// as fastest so it gets measured.
+void Engine::RankPeers(std::vector<NodeInfo>::iterator begin, std::vector<NodeInfo>::iterator end) {
+  auto rank = [&](const NodeInfo& n) {
+    Liveness* l = LivenessOf(n);
+    if (!l) {
+      return std::make_pair(0, 0L);
+    }
+    const bool closed = l->breaker.load(std::memory_order_relaxed) == kBreakerClosed;
+    return std::make_pair(closed ? 0 : 1, l->ewma_us.load(std::memory_order_relaxed));
+  };
+  std::stable_sort(begin, end, [&](const NodeInfo& a, const NodeInfo& b) { return rank(a) < rank(b); });
 }
 
-std::vector<NodeInfo> Engine::PostOwners(const std::string& id, bool alive_only) {
-  if (cfg_.single_node) {
-    return std::vector<NodeInfo>{{cfg_.node_id, "127.0.0.1", cfg_.port}};
+// How long an attempt may run before it is hedged: the peer's p95, or half
+// the timeout until there are enough samples for one.
+long Engine::HedgeDelayUs(const NodeInfo& n, int timeout_ms) {
+  constexpr uint32_t kMinSamples = 20;
+  constexpr long kFloorUs = 1000;
+  const long timeout_us = (long)std::max(1, timeout_ms) * 1000;
+  Liveness* l = LivenessOf(n);
+  long delay = timeout_us / 2;
+  if (l && l->latency.samples.load(std::memory_order_relaxed) >= kMinSamples) {
+    delay = l->latency.Quantile(0.95);
   }
-  std::vector<NodeInfo> nodes = nodes_;
-  std::sort(nodes.begin(), nodes.end(), [&](const NodeInfo& a, const NodeInfo& b) {
-    auto ha = h64(id + "|" + a.id);
-    auto hb = h64(id + "|" + b.id);
-    if (ha == hb) {
-      return a.id < b.id;
+  return std::max(kFloorUs, std::min(delay, timeout_us));
+}
+
+// Token bucket in thousandths: every hedged read earns read_hedge_budget_pct
+// percent of a token, each hedge spends one, so hedges stay under that
+// share of reads. The cap bounds a burst after a quiet period.
+bool Engine::TakeHedgeToken() {
+  long tokens = hedge_tokens_.load(std::memory_order_relaxed);
+  do {
+    if (tokens < 1000) {
+      return false;
     }
-    return ha > hb;
-  });
+  } while (!hedge_tokens_.compare_exchange_weak(tokens, tokens - 1000, std::memory_order_relaxed));
+  return true;
+}
 
-  if (!alive_only) {
-    return nodes;
-  }
+// Attempts share this through a pointer into HedgedRead's frame, which
+// outlives them all: HedgedRead returns only once every one has finished.
+struct Engine::Hedge {
+  const std::vector<NodeInfo>& peers;
+  const std::string& path;
+  const std::string& body;
+  int timeout_ms;
+  std::string* hit;
+  std::unique_ptr<CallCancel[]> cancels;
+  std::vector<char> hedged;
+  std::mutex mu;
+  bool done = false;
+  size_t winner = 0;
+  size_t launched = 0;
+  size_t finished = 0;
+  std::shared_ptr<Event> progress;  // set by the next attempt to finish
+};
 
-  if (nodes.empty()) {
-    return {};
+Task<bool> Engine::HedgedRead(
+    const std::vector<NodeInfo>& peers,
+    std::string path,
+    std::string body,
+    int timeout_ms,
+    size_t ranked,
+    std::string* hit) {
+  const size_t n = peers.size();
+  if (n == 0) {
+    co_return false;
   }
-
-  std::vector<int> up(nodes.size(), 0);
-  std::vector<std::thread> workers;
-  workers.reserve(nodes.size());
-  for (size_t i = 0; i < nodes.size(); i++) {
-    workers.emplace_back([&, i]() {
-      up[i] = Alive(nodes[i]) ? 1 : 0;
-    });
+  if (cfg_.read_hedge_budget_pct > 0) {
+    constexpr long kMaxTokens = 10 * 1000;
+    const long earn = (long)std::min(cfg_.read_hedge_budget_pct, 100) * 10;
+    long tokens = hedge_tokens_.load(std::memory_order_relaxed);
+    while (tokens < kMaxTokens &&
+           !hedge_tokens_.compare_exchange_weak(tokens, std::min(kMaxTokens, tokens + earn), std::memory_order_relaxed)) {
+    }
   }
-  for (auto& worker : workers) {
-    if (worker.joinable()) {
-      worker.join();
+
+  Hedge h{peers, path, body, timeout_ms, hit, std::unique_ptr<CallCancel[]>(new CallCancel[n]), std::vector<char>(n, 0)};
+  const RequestContext ctx = RequestContext::Capture();
+
+  // An attempt runs inline up to its first suspension and may finish right
+  // there (breaker open), so h.mu must not be held while it starts.
+  auto launch = [&](bool hedge) {
+    size_t i = 0;
+    {
+      std::lock_guard<std::mutex> lk(h.mu);
+      i = h.launched++;
+    }
+    h.hedged[i] = hedge ? 1 : 0;
+    {
+      RequestContext::Scope scope(ctx);
+      Launch(HedgeAttempt(&h, i));
+    }
+    return EventLoop::Clock::now() + std::chrono::microseconds(HedgeDelayUs(peers[i], timeout_ms));
+  };
+  // Called with h.mu held: the Event the next attempt to finish sets, so one
+  // finishing after the caller's checks still wakes it.
+  auto next_progress = [&]() {
+    h.progress = std::make_shared<Event>(loop_.get());
+    return h.progress;
+  };
+  constexpr auto kNever = EventLoop::Clock::time_point::max();
+
+  auto hedge_at = launch(false);
+  bool hedging = cfg_.read_hedge_budget_pct > 0;
+  for (;;) {
+    std::shared_ptr<Event> progress;
+    {
+      std::lock_guard<std::mutex> lk(h.mu);
+      if (h.done || h.finished == n) {
+        break;
+      }
+      if (h.finished < h.launched) {
+        progress = next_progress();
+      }
+    }
+    if (!progress) {
+      // Every attempt so far failed or missed: fail over at once, no token
+      // needed. Past the ranked peers nobody is likelier than the rest, so
+      // ask them all at once instead of one round trip each.
+      if (h.launched < ranked) {
+        hedge_at = launch(false);
+        continue;
+      }
+      while (h.launched < n) {
+        launch(false);
+      }
+      continue;
+    }
+    if (h.launched == n || !hedging) {
+      co_await progress->Wait(kNever);
+      continue;
+    }
+    const bool progressed = co_await progress->Wait(hedge_at);
+    if (progressed) {
+      continue;
+    }
+    bool more = false;
+    {
+      std::lock_guard<std::mutex> lk(h.mu);
+      more = !h.done && h.finished < h.launched;
+    }
+    if (!more) {
+      continue;
+    }
+    if (TakeHedgeToken()) {
+      hedges_.fetch_add(1, std::memory_order_relaxed);
+      hedge_at = launch(true);
+    } else {
+      hedging = false;
     }
   }
 
-  std::vector<NodeInfo> alive;
-  alive.reserve(nodes.size());
-  for (size_t i = 0; i < nodes.size(); i++) {
-    if (up[i] != 0) {
-      alive.push_back(nodes[i]);
+  bool found = false;
+  size_t launched = 0;
+  {
+    std::lock_guard<std::mutex> lk(h.mu);
+    found = h.done;
+    h.done = true;
+    launched = h.launched;
+    if (found && h.hedged[h.winner]) {
+      hedge_wins_.fetch_add(1, std::memory_order_relaxed);
     }
   }
-  return alive;
+  for (size_t i = 0; i < launched; i++) {
+    h.cancels[i].Cancel();
+  }
+  for (;;) {
+    std::shared_ptr<Event> progress;
+    {
+      std::lock_guard<std::mutex> lk(h.mu);
+      if (h.finished == h.launched) {
+        break;
+      }
+      progress = next_progress();
+    }
+    co_await progress->Wait(kNever);
+  }
+  co_return found;
 }
 
-bool Engine::Call(
-    const NodeInfo& n,
-    const std::string& path,
-    const std::string& body,
-    int* status,
-    std::string* out,
-    int timeout_ms) {
-  int call_timeout_ms = timeout_ms > 0 ? timeout_ms : cfg_.rpc_timeout_ms;
-  if (call_timeout_ms <= 0) {
-    call_timeout_ms = 450;
+Task<void> Engine::HedgeAttempt(Hedge* h, size_t i) {
+  int status = 0;
+  std::string out;
+  const bool called = co_await CallAsync(h->peers[i], h->path, h->body, &status, &out, h->timeout_ms, &h->cancels[i]);
+  const bool ok = called && status == 200 && form_parse(out)["ok"] == "1";
+  // A 404 still proves the peer is up; a cancelled attempt proves nothing.
+  if (!h->cancels[i].Cancelled()) {
+    StoreAliveMemo(h->peers[i], status > 0 && status < 500);
+  }
+  std::shared_ptr<Event> progress;
+  {
+    std::lock_guard<std::mutex> lk(h->mu);
+    if (ok && !h->done) {
+      h->done = true;
+      h->winner = i;
+      *h->hit = std::move(out);
+    }
+    h->finished++;
+    progress = std::move(h->progress);
+  }
+  // h may be gone once mu is released; progress is our own reference.
+  if (progress) {
+    progress->Set();
   }
-  auto r = post(n.host, n.port, path, body, call_timeout_ms);
-  *status = r.s;
-  *out = r.b;
-  return r.s > 0;
 }
 
 Engine::Resp Engine::CreateAccount(const Req& r) {
-  auto f = form_parse(r.body);
-  std::string id = f["id"];
-  std::string name = f["name"];
-  std::string password_hash = f["password_hash"];
+  FormView f;
+  f.Parse(r.body);
+  const std::string id(f.Get("id"));
+  const std::string name(f.Get("name"));
+  const std::string password_hash(f.Get("password_hash"));
   if (id.empty() || name.empty()) {
     return {400, form_build({{"ok", "0"}, {"error", "id_name"}})};
   }
@@ -995,27 +4910,20 @@ Engine::Resp Engine::CreateAccount(const Req& r) {
       targets.push_back(n);
     }
     std::atomic<bool> failed{false};
-    std::vector<std::thread> workers;
-    workers.reserve(targets.size());
-    for (const auto& n : targets) {
-      workers.emplace_back([&, n]() {
-        int status = 0;
-        std::string out;
-        const bool ok =
-            Call(n, "/internal/account/put", body, &status, &out) &&
-            status == 200 &&
-            form_parse(out)["ok"] == "1";
-        StoreAliveMemo(n, ok);
-        if (!ok) {
-          failed.store(true, std::memory_order_relaxed);
-        }
-      });
-    }
-    for (auto& worker : workers) {
-      if (worker.joinable()) {
-        worker.join();
+    exec_->ParallelFor(targets.size(), [&](size_t i) {
+      const NodeInfo& n = targets[i];
+      RequestDeadline request_deadline(0);
+      int status = 0;
+      std::string out;
+      const bool ok =
+          Call(n, "/internal/account/put", body, &status, &out) &&
+          status == 200 &&
+          form_parse(out)["ok"] == "1";
+      StoreAliveMemo(n, ok);
+      if (!ok) {
+        failed.store(true, std::memory_order_relaxed);
       }
-    }
+    });
     if (failed.load(std::memory_order_relaxed)) {
       return {503, form_build({{"ok", "0"}, {"error", "replicate_account"}})};
     }
@@ -1024,18 +4932,35 @@ Engine::Resp Engine::CreateAccount(const Req& r) {
   return {200, form_build({{"ok", "1"}, {"id", id}, {"name", name}})};
 }
 
-Engine::Resp Engine::GetAccount(const Req& r) {
-  auto f = form_parse(r.body);
-  std::string id = f["id"];
+namespace {
+
+// Reply for a HedgedRead() fan-out. Out of time is not a miss: a 404 here
+// would tell the client the row is gone.
+Engine::Resp hedged_result(bool found, std::string hit) {
+  if (found) {
+    return {200, std::move(hit)};
+  }
+  if (RequestDeadline::Passed()) {
+    return {504, form_build({{"ok", "0"}, {"error", "deadline"}})};
+  }
+  return {404, form_build({{"ok", "0"}, {"error", "not_found"}})};
+}
+
+}  // namespace
+
+Task<Engine::Resp> Engine::GetAccount(const Req& r) {
+  FormView f;
+  f.Parse(r.body);
+  const std::string id(f.Get("id"));
   if (id.empty()) {
-    return {400, form_build({{"ok", "0"}, {"error", "id"}})};
+    co_return {400, form_build({{"ok", "0"}, {"error", "id"}})};
   }
 
   std::string name;
   std::string password_hash;
   long created_at = 0;
   if (ReadAccount(id, &name, &password_hash, &created_at)) {
-    return {200, form_build({
+    co_return {200, form_build({
         {"ok", "1"},
         {"id", id},
         {"name", name},
@@ -1044,57 +4969,32 @@ Engine::Resp Engine::GetAccount(const Req& r) {
     })};
   }
   if (cfg_.single_node) {
-    return {404, form_build({{"ok", "0"}, {"error", "not_found"}})};
+    co_return {404, form_build({{"ok", "0"}, {"error", "not_found"}})};
   }
 
+  // Accounts are on every node: any peer will do, fastest first.
   const int read_timeout_ms = cfg_.read_remote_timeout_ms > 0 ? cfg_.read_remote_timeout_ms : cfg_.rpc_timeout_ms;
-  std::atomic<bool> found{false};
-  std::string hit;
-  std::mutex hit_mu;
-  std::vector<std::thread> workers;
-  workers.reserve(nodes_.size());
-  for (const auto& n : nodes_) {
-    if (n.id == cfg_.node_id) {
-      continue;
-    }
-    workers.emplace_back([&, n]() {
-      if (found.load(std::memory_order_relaxed)) {
-        return;
-      }
-      int status = 0;
-      std::string out;
-      const bool ok =
-          Call(n, "/internal/account/get", form_build({{"id", id}}), &status, &out, read_timeout_ms) &&
-          status == 200 &&
-          form_parse(out)["ok"] == "1";
-      StoreAliveMemo(n, ok);
-      if (!ok) {
-        return;
-      }
-      bool expected = false;
-      if (found.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
-        std::lock_guard<std::mutex> lk(hit_mu);
-        hit = std::move(out);
+  co_return co_await Coalesced("account/get:" + id, 2 * read_timeout_ms, [&]() -> Task<Resp> {
+    std::vector<NodeInfo> peers;
+    for (const auto& n : nodes_) {
+      if (n.id != cfg_.node_id) {
+        peers.push_back(n);
       }
-    });
-  }
-  for (auto& worker : workers) {
-    if (worker.joinable()) {
-      worker.join();
     }
-  }
-  if (found.load(std::memory_order_relaxed)) {
-    return {200, hit};
-  }
-
-  return {404, form_build({{"ok", "0"}, {"error", "not_found"}})};
+    RankPeers(peers.begin(), peers.end());
+    const std::string body = form_build({{"id", id}});
+    std::string hit;
+    const bool found = co_await HedgedRead(peers, "/internal/account/get", body, read_timeout_ms, 2, &hit);
+    co_return hedged_result(found, std::move(hit));
+  });
 }
 
 Engine::Resp Engine::CreatePost(const Req& r) {
-  auto f = form_parse(r.body);
-  Post p{f["id"], f["account_id"], f["title"], f["content"], now_ms()};
+  FormView f;
+  f.Parse(r.body);
+  Post p{std::string(f.Get("id")), std::string(f.Get("account_id")), std::string(f.Get("title")), std::string(f.Get("content")), now_ms()};
   if (p.id.empty()) {
-    p.id = pid_new();
+    p.id = NewPostId(&p.created_at);
   }
 
   if (p.account_id.empty() || p.title.empty() || p.content.empty()) {
@@ -1137,37 +5037,65 @@ Engine::Resp Engine::CreatePost(const Req& r) {
   });
 
   std::vector<int> replicated(owners.size(), 0);
-  std::vector<std::thread> workers;
-  workers.reserve(owners.size());
-  for (size_t i = 0; i < owners.size(); i++) {
-    workers.emplace_back([&, i]() {
-      const auto& n = owners[i];
-      bool ok = false;
-      if (n.id == cfg_.node_id) {
-        bool created = false;
-        ok = PutPost(p, true, &created) && created;
-      } else {
-        int status = 0;
-        std::string out;
-        ok = Call(n, "/internal/post/put", body, &status, &out) &&
-            status == 200 &&
-            form_parse(out)["ok"] == "1";
-        StoreAliveMemo(n, ok);
-      }
-      replicated[i] = ok ? 1 : 0;
-    });
-  }
-  for (auto& worker : workers) {
-    if (worker.joinable()) {
-      worker.join();
+  exec_->ParallelFor(owners.size(), [&](size_t i) {
+    const auto& n = owners[i];
+    RequestDeadline request_deadline(0);
+    bool ok = false;
+    if (n.id == cfg_.node_id) {
+      bool created = false;
+      ok = PutPost(p, true, &created) && created;
+    } else {
+      int status = 0;
+      std::string out;
+      ok = Call(n, "/internal/post/put", body, &status, &out) &&
+          status == 200 &&
+          form_parse(out)["ok"] == "1";
+      StoreAliveMemo(n, ok);
     }
-  }
+    replicated[i] = ok ? 1 : 0;
+  });
   for (int ok : replicated) {
     if (ok == 0) {
       return {503, form_build({{"ok", "0"}, {"error", "replicate_post"}})};
     }
   }
 
+  // Remember which nodes hold this account's posts so /post/by_account only
+  // asks them. Peers are told only when the set grows, which is rare, and off
+  // the request path; a peer that misses it re-checks once its hint expires.
+  if (!cfg_.single_node) {
+    std::vector<std::string> owner_ids;
+    for (const auto& n : owners) {
+      owner_ids.push_back(n.id);
+    }
+    bool changed = false;
+    if (MergeHolders(p.account_id, owner_ids, &changed) && changed) {
+      std::string holders;
+      for (const auto& id : owner_ids) {
+        if (!holders.empty()) {
+          holders.push_back(',');
+        }
+        holders += id;
+      }
+      std::string hint = form_build({{"account_id", p.account_id}, {"nodes", holders}});
+      exec_->Post([this, hint = std::move(hint)]() {
+        std::vector<NodeInfo> peers;
+        for (const auto& n : nodes_) {
+          if (n.id != cfg_.node_id) {
+            peers.push_back(n);
+          }
+        }
+        exec_->ParallelFor(peers.size(), [&](size_t i) {
+          RequestDeadline request_deadline(0);
+          int status = 0;
+          std::string out;
+          const bool ok = Call(peers[i], "/internal/account/holders", hint, &status, &out) && status == 200;
+          StoreAliveMemo(peers[i], ok);
+        });
+      });
+    }
+  }
+
   return {200, form_build({
       {"ok", "1"},
       {"id", p.id},
@@ -1178,16 +5106,17 @@ Engine::Resp Engine::CreatePost(const Req& r) {
   })};
 }
 
-Engine::Resp Engine::GetPost(const Req& r) {
-  auto f = form_parse(r.body);
-  std::string id = f["id"];
+Task<Engine::Resp> Engine::GetPost(const Req& r) {
+  FormView f;
+  f.Parse(r.body);
+  const std::string id(f.Get("id"));
   if (id.empty()) {
-    return {400, form_build({{"ok", "0"}, {"error", "id"}})};
+    co_return {400, form_build({{"ok", "0"}, {"error", "id"}})};
   }
 
   Post p;
   if (ReadPost(id, &p)) {
-    return {200, form_build({
+    co_return {200, form_build({
         {"ok", "1"},
         {"id", p.id},
         {"account_id", p.account_id},
@@ -1197,197 +5126,277 @@ Engine::Resp Engine::GetPost(const Req& r) {
     })};
   }
   if (cfg_.single_node) {
-    return {404, form_build({{"ok", "0"}, {"error", "not_found"}})};
+    co_return {404, form_build({{"ok", "0"}, {"error", "not_found"}})};
   }
 
+  // HRW order, with the two replicas ranked by speed ahead of the rest (a
+  // post lands elsewhere only if an owner was down when it was written).
   const int read_timeout_ms = cfg_.read_remote_timeout_ms > 0 ? cfg_.read_remote_timeout_ms : cfg_.rpc_timeout_ms;
-  const auto owners = PostOwners(id, false);
-  std::atomic<bool> found{false};
-  std::string hit;
-  std::mutex hit_mu;
-  std::vector<std::thread> workers;
-  workers.reserve(owners.size());
-  for (const auto& n : owners) {
-    if (n.id == cfg_.node_id) {
-      continue;
+  co_return co_await Coalesced("post/get:" + id, 2 * read_timeout_ms, [&]() -> Task<Resp> {
+    const auto owners = PostOwners(id, false);
+    std::vector<NodeInfo> peers;
+    size_t replicas = 0;
+    for (size_t i = 0; i < owners.size(); i++) {
+      if (owners[i].id == cfg_.node_id) {
+        continue;
+      }
+      replicas += i < 2 ? 1 : 0;
+      peers.push_back(owners[i]);
     }
-    workers.emplace_back([&, n]() {
-      if (found.load(std::memory_order_relaxed)) {
-        return;
+    RankPeers(peers.begin(), peers.begin() + (long)replicas);
+    const std::string body = form_build({{"id", id}});
+    std::string hit;
+    const bool found = co_await HedgedRead(peers, "/internal/post/get", body, read_timeout_ms, std::max<size_t>(replicas, 1), &hit);
+    co_return hedged_result(found, std::move(hit));
+  });
+}
+
+Task<Engine::Resp> Engine::ListTitles(const Req& r) {
+  FormView in;
+  in.Parse(r.body);
+  const int lim = form_limit(in, 100);
+  const bool columnar = wants_columnar(in);
+  const int wait_ms = std::max(0, cfg_.list_titles_remote_budget_ms) + std::max(0, cfg_.list_titles_remote_timeout_ms);
+  co_return co_await Coalesced("titles:" + std::to_string(lim) + (columnar ? ":columnar" : ""), wait_ms,
+                                [&]() { return MergeTitles(lim, columnar); });
+}
+
+// Local titles plus every peer's, newest first; the body of ListTitles.
+Task<Engine::Resp> Engine::MergeTitles(int lim, bool columnar) {
+  bool degraded = false;
+  bool partial = false;
+  Summaries items = LocalTitles(lim, &degraded);
+
+  if (!cfg_.single_node && cfg_.list_titles_remote_enabled) {
+    const int per_peer_limit = std::max(1, std::min(lim, cfg_.list_titles_remote_per_peer_limit));
+    const int remote_timeout_ms = cfg_.list_titles_remote_timeout_ms > 0 ? cfg_.list_titles_remote_timeout_ms : cfg_.rpc_timeout_ms;
+    const int remote_budget_ms = std::max(0, cfg_.list_titles_remote_budget_ms);
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(remote_budget_ms);
+
+    const std::string body = form_build({{"limit", std::to_string(per_peer_limit)}, {"format", "columnar"}});
+    std::mutex merge_mu;
+    // Peers dropped because this caller's own deadline ran out: the list is
+    // short for this request only, so it is marked and never shared.
+    std::atomic<bool> cut_short{false};
+    // Each fetch parks on the loop while its peer answers; fetch outlives them all.
+    auto fetch = [&](NodeInfo n) -> Task<void> {
+      if (remote_budget_ms > 0 && std::chrono::steady_clock::now() >= deadline) {
+        co_return;
       }
+
       int status = 0;
       std::string out;
-      const bool ok =
-          Call(n, "/internal/post/get", form_build({{"id", id}}), &status, &out, read_timeout_ms) &&
-          status == 200 &&
-          form_parse(out)["ok"] == "1";
+      const bool called = co_await CallAsync(n, "/internal/post/titles", body, &status, &out, remote_timeout_ms);
+      const bool ok = called && status == 200;
+      if (!ok && RequestDeadline::Passed()) {
+        cut_short.store(true, std::memory_order_relaxed);
+        co_return;
+      }
       StoreAliveMemo(n, ok);
       if (!ok) {
-        return;
+        co_return;
+      }
+
+      if (remote_budget_ms > 0 && std::chrono::steady_clock::now() >= deadline) {
+        co_return;
       }
-      bool expected = false;
-      if (found.compare_exchange_strong(expected, true, std::memory_order_acq_rel)) {
-        std::lock_guard<std::mutex> lk(hit_mu);
-        hit = std::move(out);
+
+      // One arena per reply: its parse buffers go away once the rows are merged.
+      RequestArena arena(RequestArena::kSuspendable);
+      // Peers that predate format=columnar answer with the form body.
+      Summaries got(RequestArena::Current());
+      if (!read_post_columns(out, &got)) {
+        FormView f;
+        f.Parse(out);
+        if (!read_post_list(f, &got)) {
+          co_return;
+        }
+      }
+
+      // Copies land in the handler's arena; during the fan-out it is only touched under merge_mu.
+      std::lock_guard<std::mutex> lk(merge_mu);
+      items.insert(items.end(), got.begin(), got.end());
+    };
+    std::vector<Task<void>> fetches;
+    for (const auto& n : nodes_) {
+      if (n.id != cfg_.node_id) {
+        fetches.push_back(fetch(n));
       }
-    });
-  }
-  for (auto& worker : workers) {
-    if (worker.joinable()) {
-      worker.join();
     }
-  }
-  if (found.load(std::memory_order_relaxed)) {
-    return {200, hit};
+    co_await WhenAll(loop_.get(), std::move(fetches));
+    partial = cut_short.load(std::memory_order_relaxed);
   }
 
-  return {404, form_build({{"ok", "0"}, {"error", "not_found"}})};
-}
+  finish_rows(&items, lim);
+  degraded = degraded || partial;
 
-Engine::Resp Engine::ListTitles(const Req& r) {
-  int lim = 100;
-  auto in = form_parse(r.body);
-  try {
-    lim = std::max(1, std::stoi(in["limit"]));
-  } catch (...) {
+  Resp resp;
+  if (columnar) {
+    resp = {200, post_list_columns(items, degraded), kColumnarType};
+  } else {
+    std::vector<std::pair<std::string, std::string>> out{{"ok", "1"}, {"count", std::to_string(items.size())}};
+    if (degraded) {
+      out.push_back({"degraded", "1"});
+    }
+    resp = {200, post_list_form(out, items)};
   }
+  resp.partial = partial;
+  co_return resp;
+}
 
-  std::map<std::string, Post> merged;
-  const int local_limit = lim;
-  for (const auto& p : LocalTitles(local_limit)) {
-    merged[p.id] = p;
+Task<Engine::Resp> Engine::ListByAccount(const Req& r) {
+  FormView in;
+  in.Parse(r.body);
+  const std::string account_id(in.Get("account_id"));
+  const std::string cursor(in.Get("cursor"));
+  if (account_id.empty()) {
+    co_return {400, form_build({{"ok", "0"}, {"error", "account_id"}})};
   }
+  const int lim = form_limit(in, 100);
 
-  if (!cfg_.single_node && cfg_.list_titles_remote_enabled) {
-    const int per_peer_limit = std::max(1, std::min(lim, cfg_.list_titles_remote_per_peer_limit));
+  Summaries items = LocalByAccount(account_id, cursor, lim);
+
+  if (!cfg_.single_node) {
+    // An unverified hint (older data, expired, never checked) may miss
+    // holders: every peer is asked, and also whether it holds the account's
+    // posts at all. When all of them answer, the result becomes the hint.
+    bool trusted = false;
+    const auto holders = ReadHolders(account_id, &trusted);
+    const long check_started = now_ms();
     const int remote_timeout_ms = cfg_.list_titles_remote_timeout_ms > 0 ? cfg_.list_titles_remote_timeout_ms : cfg_.rpc_timeout_ms;
-    const int remote_budget_ms = std::max(0, cfg_.list_titles_remote_budget_ms);
-    const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(remote_budget_ms);
+    const std::string body = form_build({
+        {"account_id", account_id},
+        {"cursor", cursor},
+        {"limit", std::to_string(lim)},
+        {"holds", trusted ? "0" : "1"},
+    });
 
     std::mutex merge_mu;
-    std::vector<std::thread> workers;
-    workers.reserve(nodes_.size());
+    std::vector<std::string> seen;
+    size_t answered = 0;
+    auto fetch = [&](NodeInfo n) -> Task<void> {
+      int status = 0;
+      std::string out;
+      const bool called = co_await CallAsync(n, "/internal/post/by_account", body, &status, &out, remote_timeout_ms);
+      const bool ok = called && status == 200;
+      StoreAliveMemo(n, ok);
+      if (!ok) {
+        co_return;
+      }
 
+      RequestArena arena(RequestArena::kSuspendable);
+      FormView f;
+      f.Parse(out);
+      Summaries got(RequestArena::Current());
+      if (!read_post_list(f, &got)) {
+        co_return;
+      }
+
+      std::lock_guard<std::mutex> lk(merge_mu);
+      items.insert(items.end(), got.begin(), got.end());
+      answered++;
+      if (f.Get("holds") == "1") {
+        seen.push_back(n.id);
+      }
+    };
+    std::vector<Task<void>> fetches;
     for (const auto& n : nodes_) {
       if (n.id == cfg_.node_id) {
         continue;
       }
-      workers.emplace_back([&, n]() {
-        if (remote_budget_ms > 0 && std::chrono::steady_clock::now() >= deadline) {
-          return;
-        }
+      if (trusted && std::find(holders.begin(), holders.end(), n.id) == holders.end()) {
+        continue;
+      }
+      fetches.push_back(fetch(n));
+    }
+    const size_t asked = fetches.size();
+    co_await WhenAll(loop_.get(), std::move(fetches));
+    if (!trusted && answered == asked) {
+      bool changed = false;
+      MergeHolders(account_id, seen, &changed, check_started);
+    }
+  }
 
-        int status = 0;
-        std::string out;
-        const bool ok =
-            Call(
-                n,
-                "/internal/post/titles",
-                form_build({{"limit", std::to_string(per_peer_limit)}}),
-                &status,
-                &out,
-                remote_timeout_ms) &&
-            status == 200;
-        StoreAliveMemo(n, ok);
-        if (!ok) {
-          return;
-        }
+  finish_rows(&items, lim);
 
-        if (remote_budget_ms > 0 && std::chrono::steady_clock::now() >= deadline) {
-          return;
-        }
+  std::vector<std::pair<std::string, std::string>> out{{"ok", "1"}, {"count", std::to_string(items.size())}};
+  if ((int)items.size() == lim) {
+    out.push_back({"next_cursor", rev_ts_id(items.back().created_at, std::string(items.back().id))});
+  }
+  co_return {200, post_list_form(out, items)};
+}
 
-        auto f = form_parse(out);
-        if (f["ok"] != "1") {
-          return;
-        }
+Task<Engine::Resp> Engine::Search(const Req& r) {
+  FormView in;
+  in.Parse(r.body);
+  const std::string q(in.Get("q"));
+  if (title_tokens(q).empty()) {
+    co_return {400, form_build({{"ok", "0"}, {"error", "q"}})};
+  }
+  const int lim = form_limit(in, 20);
 
-        int c = 0;
-        try {
-          c = std::stoi(f["count"]);
-        } catch (...) {
-          c = 0;
-        }
+  Summaries items = LocalSearch(q, lim);
 
-        std::lock_guard<std::mutex> lk(merge_mu);
-        for (int i = 0; i < c; i++) {
-          std::string k = std::to_string(i);
-          std::string id = f["id" + k];
-          if (id.empty()) {
-            continue;
-          }
+  if (!cfg_.single_node && cfg_.list_titles_remote_enabled) {
+    const int remote_timeout_ms = cfg_.list_titles_remote_timeout_ms > 0 ? cfg_.list_titles_remote_timeout_ms : cfg_.rpc_timeout_ms;
+    const std::string body = form_build({{"q", q}, {"limit", std::to_string(lim)}});
 
-          Post p;
-          p.id = id;
-          p.account_id = f["account_id" + k];
-          p.title = f["title" + k];
-          try {
-            p.created_at = std::stol(f["created_at" + k]);
-          } catch (...) {
-            p.created_at = 0;
-          }
+    std::mutex merge_mu;
+    auto fetch = [&](NodeInfo n) -> Task<void> {
+      int status = 0;
+      std::string out;
+      const bool called = co_await CallAsync(n, "/internal/post/search", body, &status, &out, remote_timeout_ms);
+      const bool ok = called && status == 200;
+      StoreAliveMemo(n, ok);
+      if (!ok) {
+        co_return;
+      }
 
-          auto it = merged.find(id);
-          if (it == merged.end() || p.created_at > it->second.created_at) {
-            merged[id] = p;
-          }
-        }
-      });
-    }
+      RequestArena arena(RequestArena::kSuspendable);
+      FormView f;
+      f.Parse(out);
+      Summaries got(RequestArena::Current());
+      if (!read_post_list(f, &got)) {
+        co_return;
+      }
 
-    for (auto& worker : workers) {
-      if (worker.joinable()) {
-        worker.join();
+      std::lock_guard<std::mutex> lk(merge_mu);
+      items.insert(items.end(), got.begin(), got.end());
+    };
+    std::vector<Task<void>> fetches;
+    for (const auto& n : nodes_) {
+      if (n.id != cfg_.node_id) {
+        fetches.push_back(fetch(n));
       }
     }
+    co_await WhenAll(loop_.get(), std::move(fetches));
   }
 
-  std::vector<Post> items;
-  for (const auto& it : merged) {
-    items.push_back(it.second);
-  }
-
-  std::sort(items.begin(), items.end(), [](const Post& a, const Post& b) {
-    if (a.created_at == b.created_at) {
-      return a.id > b.id;
-    }
-    return a.created_at > b.created_at;
-  });
-
-  if ((int)items.size() > lim) {
-    items.resize((size_t)lim);
-  }
+  finish_rows(&items, lim);
 
   std::vector<std::pair<std::string, std::string>> out{{"ok", "1"}, {"count", std::to_string(items.size())}};
-  for (size_t i = 0; i < items.size(); i++) {
-    std::string k = std::to_string(i);
-    out.push_back({"id" + k, items[i].id});
-    out.push_back({"account_id" + k, items[i].account_id});
-    out.push_back({"title" + k, items[i].title});
-    out.push_back({"created_at" + k, std::to_string(items[i].created_at)});
-  }
-
-  return {200, form_build(out)};
+  co_return {200, post_list_form(out, items)};
 }
 
 Engine::Resp Engine::PutAccountInternal(const Req& r) {
-  auto f = form_parse(r.body);
-  long created_at = now_ms();
-  try {
-    created_at = std::stol(f["created_at"]);
-  } catch (...) {
+  FormView f;
+  f.Parse(r.body);
+  long created_at = 0;
+  if (!to_long(f.Get("created_at"), &created_at)) {
+    created_at = now_ms();
   }
 
   bool created = false;
-  if (!PutAccount(f["id"], f["name"], f["password_hash"], created_at, false, &created)) {
+  if (!PutAccount(std::string(f.Get("id")), std::string(f.Get("name")), std::string(f.Get("password_hash")), created_at, false, &created)) {
     return {500, form_build({{"ok", "0"}})};
   }
   return {200, form_build({{"ok", "1"}})};
 }
 
 Engine::Resp Engine::GetAccountInternal(const Req& r) {
-  auto f = form_parse(r.body);
-  std::string id = f["id"];
+  FormView f;
+  f.Parse(r.body);
+  const std::string id(f.Get("id"));
   if (id.empty()) {
     return {400, form_build({{"ok", "0"}, {"error", "id"}})};
   }
@@ -1409,16 +5418,15 @@ Engine::Resp Engine::GetAccountInternal(const Req& r) {
 }
 
 Engine::Resp Engine::PutPostInternal(const Req& r) {
-  auto f = form_parse(r.body);
-  Post p{f["id"], f["account_id"], f["title"], f["content"], 0};
-  try {
-    p.created_at = std::stol(f["created_at"]);
-  } catch (...) {
+  FormView f;
+  f.Parse(r.body);
+  Post p{std::string(f.Get("id")), std::string(f.Get("account_id")), std::string(f.Get("title")), std::string(f.Get("content")), 0};
+  if (!to_long(f.Get("created_at"), &p.created_at)) {
     p.created_at = now_ms();
   }
 
   bool created = false;
-  bool if_absent = (f["if_absent"] == "1");
+  bool if_absent = (f.Get("if_absent") == "1");
   if (!PutPost(p, if_absent, &created)) {
     return {500, form_build({{"ok", "0"}})};
   }
@@ -1429,9 +5437,10 @@ Engine::Resp Engine::PutPostInternal(const Req& r) {
 }
 
 Engine::Resp Engine::GetPostInternal(const Req& r) {
-  auto f = form_parse(r.body);
+  FormView f;
+  f.Parse(r.body);
   Post p;
-  if (!ReadPost(f["id"], &p)) {
+  if (!ReadPost(std::string(f.Get("id")), &p)) {
     return {404, form_build({{"ok", "0"}})};
   }
   return {200, form_build({
@@ -1444,28 +5453,619 @@ Engine::Resp Engine::GetPostInternal(const Req& r) {
   })};
 }
 
-Engine::Resp Engine::ListTitlesInternal(const Req& r) {
-  int lim = 100;
-  auto in = form_parse(r.body);
-  try {
-    lim = std::max(1, std::stoi(in["limit"]));
-  } catch (...) {
+Task<Engine::Resp> Engine::ListTitlesInternal(const Req& r) {
+  FormView in;
+  in.Parse(r.body);
+  const int lim = form_limit(in, 100);
+  const bool columnar = wants_columnar(in);
+
+  // Every peer's ListTitles asks with the same limit, so a herd lands here as identical requests.
+  const std::string key = "internal/titles:" + std::to_string(lim) + (columnar ? ":columnar" : "");
+  co_return co_await Coalesced(key, std::max(1, cfg_.rpc_timeout_ms), [&]() -> Task<Resp> {
+    bool degraded = false;
+    auto items = LocalTitles(lim, &degraded);
+    if (columnar) {
+      co_return {200, post_list_columns(items, degraded), kColumnarType};
+    }
+    std::vector<std::pair<std::string, std::string>> out{{"ok", "1"}, {"count", std::to_string(items.size())}};
+    if (degraded) {
+      out.push_back({"degraded", "1"});
+    }
+    co_return {200, post_list_form(out, items)};
+  });
+}
+
+Engine::Resp Engine::ListByAccountInternal(const Req& r) {
+  FormView in;
+  in.Parse(r.body);
+  if (in.Get("account_id").empty()) {
+    return {400, form_build({{"ok", "0"}, {"error", "account_id"}})};
   }
+  const int lim = form_limit(in, 100);
 
-  auto items = LocalTitles(lim);
+  const std::string account_id(in.Get("account_id"));
+  const std::string cursor(in.Get("cursor"));
+  auto items = LocalByAccount(account_id, cursor, lim);
   std::vector<std::pair<std::string, std::string>> out{{"ok", "1"}, {"count", std::to_string(items.size())}};
-  for (size_t i = 0; i < items.size(); i++) {
-    std::string k = std::to_string(i);
-    out.push_back({"id" + k, items[i].id});
-    out.push_back({"account_id" + k, items[i].account_id});
-    out.push_back({"title" + k, items[i].title});
-    out.push_back({"created_at" + k, std::to_string(items[i].created_at)});
+  if (in.Get("holds") == "1") {
+    const bool holds = (cursor.empty() && !items.empty()) || !LocalByAccount(account_id, "", 1).empty();
+    out.push_back({"holds", holds ? "1" : "0"});
+  }
+  return {200, post_list_form(out, items)};
+}
+
+Engine::Resp Engine::SearchInternal(const Req& r) {
+  FormView in;
+  in.Parse(r.body);
+  const int lim = form_limit(in, 20);
+
+  auto items = LocalSearch(std::string(in.Get("q")), lim);
+  std::vector<std::pair<std::string, std::string>> out{{"ok", "1"}, {"count", std::to_string(items.size())}};
+  return {200, post_list_form(out, items)};
+}
+
+Engine::Resp Engine::PutHoldersInternal(const Req& r) {
+  auto f = form_parse(r.body);
+  if (f["account_id"].empty()) {
+    return {400, form_build({{"ok", "0"}, {"error", "account_id"}})};
+  }
+  bool changed = false;
+  if (!MergeHolders(f["account_id"], split_csv(f["nodes"]), &changed)) {
+    return {500, form_build({{"ok", "0"}})};
+  }
+  return {200, form_build({{"ok", "1"}})};
+}
+
+Engine::Resp Engine::CreateCheckpoint() {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  const std::string id = std::to_string(now_ms());
+  const std::string dir = cfg_.db_path + ".checkpoints/" + id;
+
+  std::error_code ec;
+  std::filesystem::create_directories(cfg_.db_path + ".checkpoints", ec);
+  if (ec) {
+    return {500, form_build({{"ok", "0"}, {"error", "dir"}})};
+  }
+
+  // SST and blob files are hard-linked, so this is cheap even on a large DB;
+  // log_size_for_flush=0 flushes memtables first so no WAL has to be shipped.
+  rocksdb::Checkpoint* raw = nullptr;
+  if (!rocksdb::Checkpoint::Create(db, &raw).ok()) {
+    return {500, form_build({{"ok", "0"}, {"error", "checkpoint"}})};
   }
+  std::unique_ptr<rocksdb::Checkpoint> cp(raw);
+  uint64_t seq = 0;
+  if (!cp->CreateCheckpoint(dir, 0, &seq).ok()) {
+    return {500, form_build({{"ok", "0"}, {"error", "checkpoint"}})};
+  }
+
+  std::vector<std::pair<std::string, std::string>> out{{"ok", "1"}, {"id", id}, {"seq", std::to_string(seq)}};
+  size_t count = 0;
+  for (const auto& e : std::filesystem::directory_iterator(dir, ec)) {
+    if (!e.is_regular_file()) {
+      continue;
+    }
+    std::string k = std::to_string(count++);
+    out.push_back({"name" + k, e.path().filename().string()});
+    out.push_back({"size" + k, std::to_string(e.file_size())});
+  }
+  out.insert(out.begin() + 1, {"count", std::to_string(count)});
   return {200, form_build(out)};
 }
 
-Engine::Resp Engine::Ping() {
+Engine::Resp Engine::CheckpointFile(const Req& r) {
+  auto f = form_parse(r.body);
+  if (!checkpoint_name_ok(f["id"]) || !checkpoint_name_ok(f["name"])) {
+    return {400, form_build({{"ok", "0"}, {"error", "name"}})};
+  }
+  size_t offset = 0;
+  try {
+    offset = (size_t)std::stoull(f["offset"]);
+  } catch (...) {
+    offset = 0;
+  }
+
+  std::ifstream in(cfg_.db_path + ".checkpoints/" + f["id"] + "/" + f["name"], std::ios::binary);
+  if (!in) {
+    return {404, form_build({{"ok", "0"}, {"error", "not_found"}})};
+  }
+  in.seekg((std::streamoff)offset);
+  std::string chunk(kCheckpointChunkBytes, '\0');
+  in.read(&chunk[0], (std::streamsize)chunk.size());
+  chunk.resize((size_t)in.gcount());
+  return {200, std::move(chunk), "application/octet-stream"};
+}
+
+Engine::Resp Engine::ReleaseCheckpoint(const Req& r) {
+  auto f = form_parse(r.body);
+  if (!checkpoint_name_ok(f["id"])) {
+    return {400, form_build({{"ok", "0"}, {"error", "id"}})};
+  }
+  std::error_code ec;
+  std::filesystem::remove_all(cfg_.db_path + ".checkpoints/" + f["id"], ec);
+  return {200, form_build({{"ok", "1"}})};
+}
+
+// Seeds an empty DB_PATH from a peer checkpoint. The first round copies every
+// file; the second takes a fresh checkpoint and only fetches files that are
+// new or changed (SST and blob files are immutable, so same name and size
+// means same content), which keeps the gap to the live peer short.
+bool Engine::BootstrapFromPeer() {
+  if (std::filesystem::exists(cfg_.db_path + "/CURRENT")) {
+    return true;
+  }
+  const NodeInfo* peer = nullptr;
+  for (const auto& n : nodes_) {
+    if (n.id == cfg_.bootstrap_from && n.id != cfg_.node_id) {
+      peer = &n;
+    }
+  }
+  if (!peer) {
+    return false;
+  }
+
+  const auto started = std::chrono::steady_clock::now();
+  const std::string staging = cfg_.db_path + ".bootstrap";
+  std::error_code ec;
+  std::filesystem::remove_all(staging, ec);
+  std::filesystem::create_directories(staging, ec);
+  if (ec) {
+    return false;
+  }
+
+  size_t fetched_bytes = 0;
+  for (int round = 0; round < 2; round++) {
+    int status = 0;
+    std::string out;
+    if (!Call(*peer, "/internal/checkpoint/create", "", &status, &out, cfg_.bootstrap_timeout_ms) || status != 200) {
+      return false;
+    }
+    FormView f;
+    f.Parse(out);
+    const std::string id(f.Get("id"));
+    long count = 0;
+    if (!to_long(f.Get("count"), &count)) {
+      count = 0;
+    }
+
+    std::set<std::string> names;
+    bool ok = f.Get("ok") == "1" && checkpoint_name_ok(id);
+    for (long i = 0; ok && i < count; i++) {
+      const std::string name(f.At("name", i));
+      long parsed_size = 0;
+      if (!to_long(f.At("size", i), &parsed_size) || parsed_size < 0) {
+        ok = false;
+        break;
+      }
+      const size_t size = (size_t)parsed_size;
+      if (!checkpoint_name_ok(name)) {
+        ok = false;
+        break;
+      }
+      names.insert(name);
+
+      const std::string path = staging + "/" + name;
+      const bool immutable = name.size() > 4 &&
+          (name.compare(name.size() - 4, 4, ".sst") == 0 || name.compare(name.size() - 5, 5, ".blob") == 0);
+      if (immutable && std::filesystem::exists(path) && std::filesystem::file_size(path, ec) == size) {
+        continue;
+      }
+
+      std::ofstream file(path + ".tmp", std::ios::binary | std::ios::trunc);
+      size_t offset = 0;
+      while (ok && offset < size) {
+        std::string chunk;
+        ok = Call(*peer, "/internal/checkpoint/file",
+                  form_build({{"id", id}, {"name", name}, {"offset", std::to_string(offset)}}),
+                  &status, &chunk, cfg_.bootstrap_timeout_ms) &&
+            status == 200 && !chunk.empty();
+        if (ok) {
+          file.write(chunk.data(), (std::streamsize)chunk.size());
+          offset += chunk.size();
+        }
+      }
+      file.close();
+      ok = ok && file.good();
+      if (ok) {
+        std::filesystem::rename(path + ".tmp", path, ec);
+        ok = !ec;
+      }
+      fetched_bytes += offset;
+    }
+
+    Call(*peer, "/internal/checkpoint/release", form_build({{"id", id}}), &status, &out, cfg_.bootstrap_timeout_ms);
+    if (!ok) {
+      return false;
+    }
+
+    // Drop files the newer checkpoint no longer references (compacted away).
+    for (const auto& e : std::filesystem::directory_iterator(staging, ec)) {
+      if (names.count(e.path().filename().string()) == 0) {
+        std::filesystem::remove(e.path(), ec);
+      }
+    }
+    std::cout << "[kvs] bootstrap from=" << peer->id << " round=" << round
+              << " files=" << count << " seq=" << f.Get("seq") << std::endl;
+  }
+
+  std::filesystem::remove_all(cfg_.db_path, ec);
+  std::filesystem::rename(staging, cfg_.db_path, ec);
+  if (ec) {
+    return false;
+  }
+  std::cout << "[kvs] bootstrap done bytes=" << fetched_bytes
+            << " ms=" << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count()
+            << std::endl;
+  return true;
+}
+
+// Body: one form-encoded record per line (type=account|post|holders). Rows
+// for every column family, including the t:/u:/search indexes, are sorted
+// in memory, written with SstFileWriter and ingested in one file per CF.
+// Parsing and SST writing run without mu_; live writes only wait while the
+// existing posts are looked up and the files are ingested.
+Engine::Resp Engine::BulkIngest(const Req& r) {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* def_cf = static_cast<rocksdb::ColumnFamilyHandle*>(def_cf_);
+  auto* acc_cf = static_cast<rocksdb::ColumnFamilyHandle*>(acc_cf_);
+  auto* post_cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+  auto* search_cf = static_cast<rocksdb::ColumnFamilyHandle*>(search_cf_);
+
+  struct BulkPost {
+    std::string id;
+    std::string account_id;
+    std::string title;
+    std::string summary;
+    long created_at = 0;
+  };
+  SstRows acc_rows;
+  SstRows post_rows;
+  SstRows search_rows;
+  std::vector<BulkPost> posts;
+  std::map<std::string, size_t> post_pos;
+  std::vector<std::pair<std::string, std::vector<std::string>>> holders;
+  long accounts = 0;
+
+  // One view reused for every line: its buffers keep their capacity, so
+  // parsing a line allocates nothing once the longest line has been seen.
+  FormView f;
+  const std::string_view body(r.body);
+  size_t p = 0;
+  while (p < body.size()) {
+    size_t e = body.find('\n', p);
+    if (e == std::string_view::npos) {
+      e = body.size();
+    }
+    f.Parse(body.substr(p, e - p));
+    p = e + 1;
+
+    const std::string_view type = f.Get("type");
+    if (type == "account" && !f.Get("id").empty()) {
+      const std::string id(f.Get("id"));
+      const std::string_view created_at = f.Get("created_at");
+      acc_rows.Put("a:" + id, form_build({
+          {"id", id},
+          {"name", std::string(f.Get("name"))},
+          {"password_hash", std::string(f.Get("password_hash"))},
+          {"created_at", created_at.empty() ? std::to_string(now_ms()) : std::string(created_at)},
+      }));
+      accounts++;
+    } else if (type == "holders" && !f.Get("account_id").empty()) {
+      holders.push_back({std::string(f.Get("account_id")), split_csv(std::string(f.Get("nodes")))});
+    } else if (type == "post" && !f.Get("id").empty()) {
+      BulkPost bp;
+      bp.id = f.Get("id");
+      bp.account_id = f.Get("account_id");
+      bp.title = f.Get("title");
+      if (!to_long(f.Get("created_at"), &bp.created_at)) {
+        bp.created_at = now_ms();
+      }
+      bp.summary = post_summary(bp.id, bp.account_id, bp.title, bp.created_at);
+
+      // A repeated id replaces the earlier line, index rows included.
+      auto seen = post_pos.find(bp.id);
+      if (seen != post_pos.end()) {
+        const BulkPost& prev = posts[seen->second];
+        post_rows.Delete(title_index_key(prev.created_at, prev.id));
+        if (!prev.account_id.empty()) {
+          post_rows.Delete(account_index_key(prev.account_id, prev.created_at, prev.id));
+        }
+      }
+      post_rows.Put("p:" + bp.id, form_build({
+          {"id", bp.id},
+          {"account_id", bp.account_id},
+          {"title", bp.title},
+          {"content", std::string(f.Get("content"))},
+          {"created_at", std::to_string(bp.created_at)},
+      }));
+      post_rows.Put(title_index_key(bp.created_at, bp.id), bp.summary);
+      if (!bp.account_id.empty()) {
+        post_rows.Put(account_index_key(bp.account_id, bp.created_at, bp.id), bp.summary);
+      }
+      if (seen != post_pos.end()) {
+        posts[seen->second] = std::move(bp);
+      } else {
+        post_pos[bp.id] = posts.size();
+        posts.push_back(std::move(bp));
+      }
+    }
+  }
+
+  // Doc numbers are reserved and persisted up front, so the search SST never
+  // carries meta:next_doc and cannot roll back a counter live writes advanced.
+  std::pair<uint32_t, uint32_t> docs{0, 0};
+  if (!posts.empty()) {
+    std::lock_guard<std::mutex> lk(mu_);
+    const uint32_t last = search_next_doc_ + (uint32_t)posts.size();
+    if (!db->Put(rocksdb::WriteOptions(), search_cf, kSearchNextDocKey, std::to_string(last)).ok()) {
+      return {500, form_build({{"ok", "0"}, {"error", "db"}})};
+    }
+    docs = {search_next_doc_ + 1, last};
+    search_next_doc_ = last;
+    bulk_docs_.push_back(docs);
+  }
+  auto release_docs = [&]() {
+    bulk_docs_.erase(std::remove(bulk_docs_.begin(), bulk_docs_.end(), docs), bulk_docs_.end());
+  };
+  std::map<std::string, std::vector<uint32_t>> postings;
+  uint32_t doc = docs.first;
+  for (const auto& bp : posts) {
+    search_rows.Put(search_doc_key(doc), bp.summary);
+    search_rows.Put("r:" + bp.id, search_ref(doc, bp.created_at));
+    for (const auto& t : title_index_tokens(bp.title)) {
+      postings[t].push_back(doc);
+    }
+    doc++;
+  }
+  for (auto& kv : postings) {
+    search_rows.Merge("s:" + kv.first, encode_postings(kv.second));
+  }
+
+  const std::string dir = cfg_.db_path + ".ingest";
+  std::error_code ec;
+  std::filesystem::create_directories(dir, ec);
+  static std::atomic<long> ingest_seq{0};
+  const std::string stem = dir + "/" + std::to_string(now_ms()) + "-" + std::to_string(ingest_seq.fetch_add(1));
+  if (!write_sst(db, acc_cf, acc_rows, stem + "-account.sst") ||
+      !write_sst(db, post_cf, post_rows, stem + "-post.sst") ||
+      !write_sst(db, search_cf, search_rows, stem + "-search.sst")) {
+    std::lock_guard<std::mutex> lk(mu_);
+    release_docs();
+    return {500, form_build({{"ok", "0"}, {"error", "ingest"}})};
+  }
+
+  bool stale_pending = false;
+  {
+    std::lock_guard<std::mutex> lk(mu_);
+    release_docs();
+    // Posts that already exist leave t:/u: rows under their old created_at or
+    // account and a d: row for their old doc; those go once the new rows are in.
+    rocksdb::WriteBatch stale;
+    std::vector<std::pair<std::string, std::string>> replaced{{"count", "0"}};
+    std::vector<std::string> keys;
+    for (const auto& bp : posts) {
+      keys.push_back("p:" + bp.id);
+    }
+    std::vector<rocksdb::Slice> key_slices(keys.begin(), keys.end());
+    std::vector<rocksdb::PinnableSlice> values(keys.size());
+    std::vector<rocksdb::Status> statuses(keys.size());
+    db->MultiGet(rocksdb::ReadOptions(), post_cf, keys.size(), key_slices.data(), values.data(), statuses.data());
+    for (size_t i = 0; i < posts.size(); i++) {
+      if (!statuses[i].ok()) {
+        continue;
+      }
+      const auto& bp = posts[i];
+      const std::string old_value = values[i].ToString();
+      stage_stale_post_rows(&stale, post_cf, old_value, bp.id, bp.account_id, bp.created_at);
+      std::string ref;
+      const uint32_t old_doc = db->Get(rocksdb::ReadOptions(), search_cf, "r:" + bp.id, &ref).ok() ? search_ref_doc(ref) : 0;
+      if (old_doc > 0) {
+        stale.Delete(search_cf, search_doc_key(old_doc));
+      }
+      const std::string k = std::to_string(replaced.size() / 3);
+      replaced.push_back({"id" + k, bp.id});
+      replaced.push_back({"old" + k, old_value});
+      replaced.push_back({"doc" + k, std::to_string(old_doc)});
+    }
+    replaced[0].second = std::to_string(replaced.size() / 3);
+
+    if (!ingest_ssts(db, {{acc_cf, &acc_rows, stem + "-account.sst"},
+                          {post_cf, &post_rows, stem + "-post.sst"},
+                          {search_cf, &search_rows, stem + "-search.sst"}})) {
+      return {500, form_build({{"ok", "0"}, {"error", "ingest"}})};
+    }
+    // The load is in; only rows of the replaced versions are left. Keep what
+    // they were so RepairStaleRows() can delete them rather than fail the load.
+    if (stale.Count() > 0 && !db->Write(rocksdb::WriteOptions(), &stale).ok()) {
+      const std::string key = kStaleRowsPrefix + std::filesystem::path(stem).filename().string();
+      if (!db->Put(rocksdb::WriteOptions(), def_cf, key, form_build(replaced)).ok()) {
+        std::cerr << "[kvs] bulk ingest: stale index rows of " << (replaced.size() / 3) << " posts left behind" << std::endl;
+        return {500, form_build({{"ok", "0"}, {"error", "stale_rows"}})};
+      }
+      stale_pending = true;
+    }
+  }
+  if (stale_pending) {
+    exec_->Post([this]() { RepairStaleRows(); });
+  }
+
+  for (const auto& h : holders) {
+    bool changed = false;
+    if (!MergeHolders(h.first, h.second, &changed)) {
+      return {500, form_build({{"ok", "0"}, {"error", "holders"}})};
+    }
+  }
+  return {200, form_build({
+      {"ok", "1"},
+      {"accounts", std::to_string(accounts)},
+      {"posts", std::to_string(posts.size())},
+      {"stale_repair", stale_pending ? "1" : "0"},
+  })};
+}
+
+// Finishes the kStaleRowsPrefix records BulkIngest left: for each post, the
+// t:/u: rows of the version it replaced that the current version does not
+// write, and that version's d: row unless r: points at it again. Runs at
+// start and after the failed ingest; a record goes in the batch that does its
+// deletes, so a failure leaves it for the next run.
+void Engine::RepairStaleRows() {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  auto* def_cf = static_cast<rocksdb::ColumnFamilyHandle*>(def_cf_);
+  auto* post_cf = static_cast<rocksdb::ColumnFamilyHandle*>(post_cf_);
+  auto* search_cf = static_cast<rocksdb::ColumnFamilyHandle*>(search_cf_);
+
+  std::vector<std::pair<std::string, std::string>> records;
+  {
+    std::unique_ptr<rocksdb::Iterator> it(db->NewIterator(rocksdb::ReadOptions(), def_cf));
+    for (it->Seek(kStaleRowsPrefix); it->Valid() && it->key().starts_with(kStaleRowsPrefix); it->Next()) {
+      records.push_back({it->key().ToString(), it->value().ToString()});
+    }
+  }
+
+  for (const auto& rec : records) {
+    FormView f;
+    f.Parse(rec.second);
+    std::lock_guard<std::mutex> lk(mu_);
+    rocksdb::WriteBatch batch;
+    for (size_t i = 0; i < f.Size("id"); i++) {
+      const std::string id(f.At("id", i));
+      // A post gone since (retention) keeps nothing: every old row goes.
+      std::string cur_value;
+      std::string cur_account;
+      long cur_created_at = -1;
+      if (db->Get(rocksdb::ReadOptions(), post_cf, "p:" + id, &cur_value).ok()) {
+        auto cur = form_parse(cur_value);
+        cur_account = cur["account_id"];
+        to_long(cur["created_at"], &cur_created_at);
+      }
+      stage_stale_post_rows(&batch, post_cf, std::string(f.At("old", i)), id, cur_account, cur_created_at);
+      long doc = 0;
+      std::string ref;
+      if (to_long(f.At("doc", i), &doc) && doc > 0 &&
+          !(db->Get(rocksdb::ReadOptions(), search_cf, "r:" + id, &ref).ok() && search_ref_doc(ref) == (uint32_t)doc)) {
+        batch.Delete(search_cf, search_doc_key((uint32_t)doc));
+      }
+    }
+    batch.Delete(def_cf, rec.first);
+    if (!db->Write(rocksdb::WriteOptions(), &batch).ok()) {
+      std::cerr << "[kvs] stale row repair failed, kept " << rec.first << std::endl;
+      return;
+    }
+    std::cout << "[kvs] stale rows repaired " << rec.first << " posts=" << f.Size("id") << std::endl;
+  }
+}
+
+// Post writes go to the WAL without fsync; this bounds how much a host crash
+// can lose to one interval. The last pass runs after stop_ for a clean exit.
+void Engine::WalSyncLoop() {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  const auto interval = std::chrono::milliseconds(cfg_.wal_sync_interval_ms);
+  std::unique_lock<std::mutex> lk(wal_mu_);
+  while (true) {
+    const bool stopping = wal_cv_.wait_for(lk, interval, [&]() { return stop_.load(); });
+    lk.unlock();
+    if (db->SyncWAL().ok()) {
+      wal_syncs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    lk.lock();
+    if (stopping) {
+      break;
+    }
+  }
+}
+
+Engine::Resp Engine::SyncWal() {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  if (!db->SyncWAL().ok()) {
+    return {500, form_build({{"ok", "0"}, {"error", "wal_sync"}})};
+  }
+  wal_syncs_.fetch_add(1, std::memory_order_relaxed);
   return {200, form_build({{"ok", "1"}})};
 }
 
+Engine::Resp Engine::WriteStats() {
+  static const char* const names[kWriteClasses] = {"account", "post", "repair"};
+  std::vector<std::pair<std::string, std::string>> kv{{"ok", "1"}};
+  for (int c = 0; c < kWriteClasses; c++) {
+    const auto& l = write_latency_[c];
+    const long count = l.count.load(std::memory_order_relaxed);
+    const long total = l.total_us.load(std::memory_order_relaxed);
+    kv.emplace_back(std::string(names[c]) + "_count", std::to_string(count));
+    kv.emplace_back(std::string(names[c]) + "_avg_us", std::to_string(count > 0 ? total / count : 0));
+    kv.emplace_back(std::string(names[c]) + "_max_us", std::to_string(l.max_us.load(std::memory_order_relaxed)));
+  }
+  kv.emplace_back("wal_syncs", std::to_string(wal_syncs_.load(std::memory_order_relaxed)));
+  return {200, form_build(kv)};
+}
+
+// Liveness as this node sees it; ttl_ms is how long the cached verdict still holds.
+Engine::Resp Engine::PeerStats() {
+  std::vector<std::pair<std::string, std::string>> kv{
+      {"ok", "1"},
+      {"hedges", std::to_string(hedges_.load(std::memory_order_relaxed))},
+      {"hedge_wins", std::to_string(hedge_wins_.load(std::memory_order_relaxed))},
+      {"coalesced", std::to_string(coalesced_.load(std::memory_order_relaxed))},
+      {"count", std::to_string(nodes_.size())},
+  };
+  const long now = now_ms();
+  for (const auto& n : nodes_) {
+    const Liveness& l = live_[n.slot];
+    const long memo = l.memo.load(std::memory_order_relaxed);
+    const std::string i = std::to_string(n.slot);
+    const bool cached = (memo >> 1) > now;
+    kv.emplace_back("id" + i, n.id);
+    kv.emplace_back("state" + i, n.id == cfg_.node_id ? "self" : !cached ? "unknown" : (memo & 1) ? "up" : "down");
+    kv.emplace_back("ttl_ms" + i, std::to_string(cached ? (memo >> 1) - now : 0));
+    kv.emplace_back("ewma_us" + i, std::to_string(l.ewma_us.load(std::memory_order_relaxed)));
+    kv.emplace_back("p95_us" + i, std::to_string(l.latency.Quantile(0.95)));
+    kv.emplace_back("p99_us" + i, std::to_string(l.latency.Quantile(0.99)));
+    kv.emplace_back("failures" + i, std::to_string(l.failures.load(std::memory_order_relaxed)));
+    static const char* const breaker[] = {"closed", "open", "half_open"};
+    kv.emplace_back("breaker" + i, breaker[l.breaker.load(std::memory_order_relaxed)]);
+    kv.emplace_back("trips" + i, std::to_string(l.trips.load(std::memory_order_relaxed)));
+    kv.emplace_back("ejections" + i, std::to_string(l.ejections.load(std::memory_order_relaxed)));
+  }
+  return {200, form_build(kv)};
+}
+
+// Applies the retention window now instead of waiting for periodic compaction.
+Engine::Resp Engine::RetentionCompact() {
+  auto* db = static_cast<rocksdb::DB*>(db_);
+  for (void* cf : {post_cf_, search_cf_}) {
+    if (!db->CompactRange(rocksdb::CompactRangeOptions(), static_cast<rocksdb::ColumnFamilyHandle*>(cf), nullptr, nullptr).ok()) {
+      return {500, form_build({{"ok", "0"}, {"error", "compact"}})};
+    }
+  }
+  return RetentionStatus();
+}
+
+Engine::Resp Engine::RetentionStatus() {
+  return {200, form_build({
+      {"ok", "1"},
+      {"retention_days", std::to_string(cfg_.retention_days)},
+      {"posts", std::to_string(retention_.posts.load(std::memory_order_relaxed))},
+      {"titles", std::to_string(retention_.titles.load(std::memory_order_relaxed))},
+      {"account_rows", std::to_string(retention_.account_rows.load(std::memory_order_relaxed))},
+      {"docs", std::to_string(retention_.docs.load(std::memory_order_relaxed))},
+      {"refs", std::to_string(retention_.refs.load(std::memory_order_relaxed))},
+      {"postings", std::to_string(retention_.postings.load(std::memory_order_relaxed))},
+      {"archived", std::to_string(retention_.archived.load(std::memory_order_relaxed))},
+      {"archive_failed", std::to_string(retention_.archive_failed.load(std::memory_order_relaxed))},
+  })};
+}
+
+Engine::Resp Engine::Ping() {
+  return {200, form_build({{"ok", "1"}, {"ready", warm_.load(std::memory_order_acquire) ? "1" : "0"}})};
+}
+
+Engine::Resp Engine::RebuildTitleIndex(const Req& r) {
+  auto f = form_parse(r.body);
+  const bool reset = f["reset"] == "1";
+  if (!reset && index_ready_) {
+    return {200, form_build({{"ok", "1"}, {"state", "ready"}})};
+  }
+  const bool started = StartTitleBackfill(reset);
+  return {200, form_build({{"ok", "1"}, {"state", started ? "started" : "running"}})};
+}
+
 }  // namespace kvs
@@ -1,15 +1,28 @@
 #pragma once
 
 #include <atomic>
-#include <map>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <memory_resource>
 #include <mutex>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 namespace kvs {
 
-struct NodeInfo { std::string id, host; int port = 0; };
+struct NodeInfo { std::string id, host; int port = 0; int slot = -1; };
+struct CallCancel;
+class Executor;
+class EventLoop;
+class Event;
+template <class T>
+class Task;
+// Request classes for Handle()'s scheduler, most favoured first.
+enum RequestClass { kClassInternalWrite = 0, kClassPublicWrite = 1, kClassInternalRead = 2, kClassPublicRead = 3, kRequestClasses = 4 };
 struct Config {
   std::string node_id;
   int port = 4000;
@@ -25,32 +38,173 @@ struct Config {
   int alive_cache_ms = 250;
   int dead_cache_ms = 80;
   int alive_probe_timeout_ms = 120;
+  int write_group_max_ops = 128;
+  bool title_backfill_on_start = true;
+  int title_backfill_chunk = 256;
+  int title_backfill_rows_per_sec = 5000;
+  bool blob_enabled = true;
+  int blob_min_size = 2048;
+  std::string blob_compression = "zstd";
+  int blob_gc_age_cutoff_pct = 25;
+  std::string bootstrap_from;
+  int bootstrap_timeout_ms = 10000;
+  int block_cache_mb = 256;
+  bool warmup_enabled = true;
+  int warmup_budget_ms = 3000;
+  int warmup_titles = 2000;
+  bool account_sync = true;
+  int wal_sync_interval_ms = 100;
+  bool repair_disable_wal = false;
+  int retention_days = 0;
+  std::string retention_archive_dir;
+  int peer_breaker_failures = 5;
+  int peer_breaker_open_ms = 1000;
+  int peer_outlier_factor = 3;
+  int peer_outlier_min_ms = 50;
+  int peer_outlier_eject_ms = 5000;
+  int read_hedge_budget_pct = 5;
+  bool adaptive_limit_enabled = true;
+  int adaptive_limit_initial = 64;
+  int adaptive_limit_max = 2000;
+  int sched_slots = 64;
+  int sched_queue_internal_write = 1024;
+  int sched_wait_ms_internal_write = 400;
+  int sched_queue_public_write = 512;
+  int sched_wait_ms_public_write = 300;
+  int sched_queue_internal_read = 512;
+  int sched_wait_ms_internal_read = 150;
+  int sched_queue_public_read = 256;
+  int sched_wait_ms_public_read = 100;
+  int executor_threads = 0;
+  int executor_max_threads = 1024;
+};
+
+// Rows dropped by the retention compaction filter since start (postings: doc entries pruned from s: lists).
+struct RetentionStats {
+  std::atomic<long> posts{0}, titles{0}, account_rows{0}, docs{0}, refs{0}, postings{0}, archived{0}, archive_failed{0};
+};
+
+// Search doc numbers whose d: row is gone, as a bitmap; the retention filter prunes them from posting lists.
+struct DeadDocs {
+  std::mutex mu; std::vector<uint64_t> bits;
+  void Add(uint32_t doc); size_t Prune(std::vector<uint32_t>* docs);
 };
 
 class Engine {
  public:
-  struct Req { std::string method, path, body; };
-  struct Resp { int status = 500; std::string body; };
+  // deadline_ms: absolute unix ms from the X-Kvs-Deadline header, 0 = none.
+  struct Req { std::string method, path, body; long deadline_ms = 0; };
+  // partial: cut short by this caller's deadline, so Coalesced() keeps it from other callers.
+  struct Resp { int status = 500; std::string body; std::string content_type; bool partial = false; };
   explicit Engine(Config cfg); ~Engine();
   bool Start(); void Stop();
+  bool BulkLoad(const std::string& path);
 
  private:
   struct Post { std::string id, account_id, title, content; long created_at = 0; };
-  bool InitDb(); void CloseDb(); void Serve(); Resp Handle(const Req&);
-  Resp CreateAccount(const Req&); Resp GetAccount(const Req&); Resp CreatePost(const Req&); Resp GetPost(const Req&); Resp ListTitles(const Req&);
-  Resp PutAccountInternal(const Req&); Resp GetAccountInternal(const Req&); Resp PutPostInternal(const Req&); Resp GetPostInternal(const Req&); Resp ListTitlesInternal(const Req&); Resp Ping();
+  // List row (titles, by_account, search). Allocator-aware so list handlers keep every row in the request arena.
+  struct Summary {
+    using allocator_type = std::pmr::polymorphic_allocator<char>;
+    std::pmr::string id, account_id, title; long created_at = 0;
+    explicit Summary(const allocator_type& a = {}) : id(a), account_id(a), title(a) {}
+    Summary(const Summary& o, const allocator_type& a) : id(o.id, a), account_id(o.account_id, a), title(o.title, a), created_at(o.created_at) {}
+    Summary(Summary&& o, const allocator_type& a) : id(std::move(o.id), a), account_id(std::move(o.account_id), a), title(std::move(o.title), a), created_at(o.created_at) {}
+    Summary(const Summary&) = default; Summary(Summary&&) = default; Summary& operator=(const Summary&) = default; Summary& operator=(Summary&&) = default;
+  };
+  using Summaries = std::pmr::vector<Summary>;
+  // Request path is a chain of coroutines (Task<Resp>): handlers that wait on peers suspend on the event loop instead of holding a worker.
+  bool InitDb(); void CloseDb(); void Serve(); Task<void> Respond(int fd, Req); void Responded(); Task<Resp> Handle(const Req&); Task<Resp> Route(const Req&);
+  Resp CreateAccount(const Req&); Task<Resp> GetAccount(const Req&); Resp CreatePost(const Req&); Task<Resp> GetPost(const Req&); Task<Resp> ListTitles(const Req&);
+  Resp PutAccountInternal(const Req&); Resp GetAccountInternal(const Req&); Resp PutPostInternal(const Req&); Resp GetPostInternal(const Req&); Task<Resp> ListTitlesInternal(const Req&); Resp Ping();
+  Resp RebuildTitleIndex(const Req&); Task<Resp> ListByAccount(const Req&); Resp ListByAccountInternal(const Req&); Resp PutHoldersInternal(const Req&);
+  Task<Resp> Search(const Req&); Resp SearchInternal(const Req&); Task<Resp> MergeTitles(int limit, bool columnar);
+  Resp CreateCheckpoint(); Resp CheckpointFile(const Req&); Resp ReleaseCheckpoint(const Req&); bool BootstrapFromPeer();
+  Resp BulkIngest(const Req&); Resp SyncWal(); Resp WriteStats(); Resp PeerStats(); Resp LimitStats(); Resp SchedStats(); Resp ExecutorStats(); void WalSyncLoop(); Resp RetentionStatus(); Resp RetentionCompact();
   bool PutAccount(const std::string&, const std::string&, const std::string&, long, bool, bool*);
   bool ReadAccount(const std::string&, std::string*, std::string*, long*);
-  bool PutPost(const Post&, bool, bool*); bool ReadPost(const std::string&, Post*); std::vector<Post> LocalTitles(int limit = 0);
+  std::string NewPostId(long* created_at = nullptr); void ExtendIdLease(uint64_t ms);
+  bool PutPost(const Post&, bool, bool*); bool ReadPost(const std::string&, Post*); Summaries LocalTitles(int limit = 0, bool* degraded = nullptr);
+  bool StartTitleBackfill(bool reset = false); void BuildTitleIndex(bool reset); void Warmup(); void ScanDeadDocs(); void RepairStaleRows();
+  Summaries LocalByAccount(const std::string&, const std::string&, int);
+  Summaries LocalSearch(const std::string&, int);
+  std::vector<std::string> ReadHolders(const std::string&, bool* trusted); bool MergeHolders(const std::string&, const std::vector<std::string>&, bool*, long verified_at = 0);
+  // Write coalescing: concurrent writers enqueue a WriteOp, one leader commits the whole group in a single WriteBatch.
+  struct WriteOp {
+    bool is_post = false; bool if_absent = false; Post post; std::string id, name, password_hash; long created_at = 0;
+    bool done = false; bool ok = false; bool created = false;
+  };
+  bool CommitWrite(WriteOp*); void ApplyWriteGroup(const std::vector<WriteOp*>&);
+  // Durability classes: accounts fsync with their group, posts wait for WalSyncLoop, index repair may skip the WAL.
+  enum WriteClass { kWriteAccount = 0, kWritePost = 1, kWriteRepair = 2, kWriteClasses = 3 };
+  struct WriteLatency { std::atomic<long> count{0}, total_us{0}, max_us{0}; };
+  void RecordWrite(WriteClass, long us);
   std::vector<NodeInfo> PostOwners(const std::string&, bool);
-  struct AliveMemo { bool alive = false; long expires_at = 0; };
+  // Peer response times: 4 buckets per power of two of microseconds, halved every kWindow samples so quantiles follow recent traffic.
+  struct LatencyHist {
+    static constexpr int kBuckets = 104; static constexpr uint32_t kWindow = 2048;
+    std::atomic<uint32_t> buckets[kBuckets] = {}; std::atomic<uint32_t> samples{0};
+    void Add(long us); long Quantile(double q) const; void Reset();
+  };
+  // Per-node liveness, indexed by NodeInfo::slot. Only atomics, so every RPC reads and updates it without a lock.
+  // memo packs (expires_at << 1 | up) into one word so a reader never pairs one store's state with another's expiry.
+  enum Breaker { kBreakerClosed = 0, kBreakerOpen = 1, kBreakerHalfOpen = 2 };
+  struct Liveness {
+    std::atomic<long> memo{0}, ewma_us{0}, open_until{0}, trips{0}, ejections{0};
+    std::atomic<int> failures{0}, breaker{kBreakerClosed};
+    LatencyHist latency;
+  };
+  Liveness* LivenessOf(const NodeInfo&);
+  bool AdmitCall(Liveness*); void RecordCall(Liveness*, int status, long us); void TripBreaker(Liveness*, long open_ms); void EjectOutliers();
   bool LookupAliveMemo(const NodeInfo&, bool*);
   void StoreAliveMemo(const NodeInfo&, bool);
-  bool Alive(const NodeInfo&); bool Call(const NodeInfo&, const std::string&, const std::string&, int*, std::string*, int timeout_ms = 0);
+  bool Alive(const NodeInfo&); bool Call(const NodeInfo&, const std::string&, const std::string&, int*, std::string*, int timeout_ms = 0, CallCancel* cancel = nullptr);
+  Task<bool> CallAsync(NodeInfo, std::string path, std::string body, int*, std::string*, int timeout_ms = 0, CallCancel* cancel = nullptr);
+  bool PrepareCall(const NodeInfo&, int timeout_ms, int* call_timeout_ms, Liveness**, int*, std::string*); void FinishCall(Liveness*, CallCancel*, int status, long us);
+  // Single-flight: concurrent callers with the same key share one in-flight resolution, waiting at most wait_ms for it.
+  struct Flight { std::unique_ptr<Event> done; Resp resp; };
+  Task<Resp> Coalesced(std::string key, int wait_ms, std::function<Task<Resp>()> work);
+  // Hedged reads (GetPost, GetAccount): best peer first, the next one after the current peer's p95 within a token budget.
+  struct Hedge; Task<bool> HedgedRead(const std::vector<NodeInfo>&, std::string path, std::string body, int timeout_ms, size_t ranked, std::string* hit); Task<void> HedgeAttempt(Hedge*, size_t);
+  void RankPeers(std::vector<NodeInfo>::iterator, std::vector<NodeInfo>::iterator); long HedgeDelayUs(const NodeInfo&, int timeout_ms); bool TakeHedgeToken();
+
+  // Adaptive concurrency limit per route (kLimitedRoutes in kvs.cc). cap is the admitted in-flight count, limit its fractional estimate.
+  struct RouteLimit {
+    std::mutex mu; double limit = 0, short_rtt_us = 0, long_rtt_us = 0;
+    std::atomic<int> inflight{0}, cap{0}; std::atomic<long> admitted{0}, rejected{0};
+  };
+  bool AdmitRoute(int route); void ReleaseRoute(int route, long us);
+  // Priority scheduler: at most sched_slots requests run, the rest wait in per-class FIFOs served by weighted round robin.
+  // Public classes leave a quarter of the slots to internal ones. All fields are guarded by sched_mu_.
+  // ready is Set() once granted; the waiter co_awaits it on loop_.
+  struct SchedWaiter { std::unique_ptr<Event> ready; bool granted = false; };
+  struct SchedClass {
+    std::deque<SchedWaiter*> queue; int credit = 0;
+    long started = 0, shed_full = 0, shed_wait = 0, forced = 0, waited = 0, wait_us = 0, max_wait_us = 0;
+  };
+  Task<bool> AcquireSlot(RequestClass, Resp* shed); void ReleaseSlot(); void GrantSlots(); int SlotCap(RequestClass) const;
 
   Config cfg_; std::vector<NodeInfo> nodes_;
-  void* db_ = nullptr; void* def_cf_ = nullptr; void* acc_cf_ = nullptr; void* post_cf_ = nullptr; std::vector<void*> cfs_;
-  std::mutex mu_; std::mutex alive_mu_; std::map<std::string, AliveMemo> alive_memo_;
+  void* db_ = nullptr; void* def_cf_ = nullptr; void* acc_cf_ = nullptr; void* post_cf_ = nullptr; void* search_cf_ = nullptr; std::vector<void*> cfs_;
+  uint32_t search_next_doc_ = 0; uint32_t id_node_ = 0; std::atomic<uint64_t> id_clock_{0};
+  // Id ms persisted as issued-up-to (meta:id_lease); 0 with no DB open (bulk-load client).
+  std::mutex id_lease_mu_; std::atomic<uint64_t> id_lease_{0};
+  std::mutex mu_; std::unique_ptr<Liveness[]> live_; std::atomic<long> outlier_eval_at_{0};
+  std::atomic<long> hedge_tokens_{0}, hedges_{0}, hedge_wins_{0}, coalesced_{0};
+  std::mutex flights_mu_; std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+  std::unique_ptr<RouteLimit[]> limits_;
+  std::mutex sched_mu_; int sched_running_ = 0; SchedClass sched_[kRequestClasses];
+  std::mutex write_mu_; std::condition_variable write_cv_; std::vector<WriteOp*> write_q_; bool write_leader_ = false;
+  std::mutex index_mu_; std::condition_variable index_cv_; std::atomic<bool> index_ready_{false}; std::atomic<bool> index_building_{false};
+  std::atomic<bool> warm_{true};
+  // Runs connection handlers, fan-out calls, warm-up and index backfill; Stop() drains it before closing the DB.
+  // loop_ parks coroutines on sockets and timers; responding_ counts requests not yet answered, parked ones included.
+  // Stop() waits on responding_cv_ until it reaches zero.
+  std::unique_ptr<Executor> exec_; std::unique_ptr<EventLoop> loop_; std::atomic<int> responding_{0};
+  std::mutex responding_mu_; std::condition_variable responding_cv_;
+  WriteLatency write_latency_[kWriteClasses]; std::mutex wal_mu_; std::condition_variable wal_cv_; std::thread wal_th_; std::atomic<long> wal_syncs_{0};
+  RetentionStats retention_; DeadDocs dead_docs_;
+  // Doc ranges a BulkIngest reserved but has not ingested yet (guarded by mu_); ScanDeadDocs must not count them dead.
+  std::vector<std::pair<uint32_t, uint32_t>> bulk_docs_;
   std::atomic<bool> stop_{false}; int listen_fd_ = -1; std::thread th_;
 };
 
@@ -21,7 +21,7 @@ bool env_b(const char* k,bool d){
 }
 }  // namespace
 
-int main(){
+int main(int argc, char** argv){
   std::signal(SIGINT,OnSig); std::signal(SIGTERM,OnSig);
   const char* ep=std::getenv("ENV_PATH"); if(ep&&*ep) load_env(ep); else { load_env(".env"); load_env("../.env"); load_env("../../.env"); }
   kvs::Config c{
@@ -38,8 +38,48 @@ int main(){
     env_b("KVS_LIST_TITLES_REMOTE_ENABLED", true),
     env_i("KVS_ALIVE_CACHE_MS", 250),
     env_i("KVS_DEAD_CACHE_MS", 80),
-    env_i("KVS_ALIVE_PING_TIMEOUT_MS", 120)
+    env_i("KVS_ALIVE_PING_TIMEOUT_MS", 120),
+    env_i("KVS_WRITE_GROUP_MAX_OPS", 128),
+    env_b("KVS_TITLE_BACKFILL_ON_START", true),
+    env_i("KVS_TITLE_BACKFILL_CHUNK", 256),
+    env_i("KVS_TITLE_BACKFILL_ROWS_PER_SEC", 5000),
+    env_b("KVS_BLOB_ENABLED", true),
+    env_i("KVS_BLOB_MIN_SIZE", 2048),
+    env("KVS_BLOB_COMPRESSION", "zstd"),
+    env_i("KVS_BLOB_GC_AGE_CUTOFF_PCT", 25),
+    env("KVS_BOOTSTRAP_FROM", ""),
+    env_i("KVS_BOOTSTRAP_TIMEOUT_MS", 10000),
+    env_i("KVS_BLOCK_CACHE_MB", 256),
+    env_b("KVS_WARMUP_ENABLED", true),
+    env_i("KVS_WARMUP_BUDGET_MS", 3000),
+    env_i("KVS_WARMUP_TITLES", 2000),
+    env_b("KVS_ACCOUNT_SYNC", true),
+    env_i("KVS_WAL_SYNC_INTERVAL_MS", 100),
+    env_b("KVS_REPAIR_DISABLE_WAL", false),
+    env_i("KVS_RETENTION_DAYS", 0),
+    env("KVS_RETENTION_ARCHIVE_DIR", ""),
+    env_i("KVS_PEER_BREAKER_FAILURES", 5),
+    env_i("KVS_PEER_BREAKER_OPEN_MS", 1000),
+    env_i("KVS_PEER_OUTLIER_FACTOR", 3),
+    env_i("KVS_PEER_OUTLIER_MIN_MS", 50),
+    env_i("KVS_PEER_OUTLIER_EJECT_MS", 5000),
+    env_i("KVS_READ_HEDGE_BUDGET_PCT", 5),
+    env_b("KVS_ADAPTIVE_LIMIT_ENABLED", true),
+    env_i("KVS_ADAPTIVE_LIMIT_INITIAL", 64),
+    env_i("KVS_ADAPTIVE_LIMIT_MAX", 2000),
+    env_i("KVS_SCHED_SLOTS", 64),
+    env_i("KVS_SCHED_QUEUE_INTERNAL_WRITE", 1024),
+    env_i("KVS_SCHED_WAIT_MS_INTERNAL_WRITE", 400),
+    env_i("KVS_SCHED_QUEUE_PUBLIC_WRITE", 512),
+    env_i("KVS_SCHED_WAIT_MS_PUBLIC_WRITE", 300),
+    env_i("KVS_SCHED_QUEUE_INTERNAL_READ", 512),
+    env_i("KVS_SCHED_WAIT_MS_INTERNAL_READ", 150),
+    env_i("KVS_SCHED_QUEUE_PUBLIC_READ", 256),
+    env_i("KVS_SCHED_WAIT_MS_PUBLIC_READ", 100),
+    env_i("KVS_EXECUTOR_THREADS", 0),
+    env_i("KVS_EXECUTOR_MAX_THREADS", 1024)
   };
+  if(argc>=3&&std::string(argv[1])=="bulk-load"){ kvs::Engine loader(c); return loader.BulkLoad(argv[2])?0:1; }
   kvs::Engine e(c); if(!e.Start()){ std::cerr<<"kvs start failed\n"; return 1; }
   while(!g_stop) std::this_thread::sleep_for(std::chrono::milliseconds(200));
   e.Stop(); return 0;
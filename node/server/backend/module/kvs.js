@@ -76,6 +76,47 @@ function formDecode(body) {
   return out;
 }
 
+// Body of /post/titles with format=columnar (see kvs.cc post_list_columns):
+// "KVC1", u32 count, u32 flags, u32 offsets[4], u32 size, then id/account_id/title
+// columns (u32 lengths + bytes) and an i64 created_at column. Little-endian.
+const COLUMNAR_TYPE = 'application/x-kvs-columns';
+
+function columnsDecode(buf) {
+  if (buf.length < 32 || buf.toString('latin1', 0, 4) !== 'KVC1' || buf.readUInt32LE(28) !== buf.length) {
+    return null;
+  }
+  const count = buf.readUInt32LE(4);
+  const flags = buf.readUInt32LE(8);
+  const offsets = [0, 1, 2, 3].map((c) => buf.readUInt32LE(12 + 4 * c));
+  if (offsets[3] + 8 * count > buf.length) {
+    return null;
+  }
+  const columns = [];
+  for (let c = 0; c < 3; c += 1) {
+    const values = new Array(count);
+    let at = offsets[c] + 4 * count;
+    for (let i = 0; i < count; i += 1) {
+      const len = buf.readUInt32LE(offsets[c] + 4 * i);
+      if (at + len > offsets[c + 1]) {
+        return null;
+      }
+      values[i] = buf.toString('utf8', at, at + len);
+      at += len;
+    }
+    columns.push(values);
+  }
+  const items = new Array(count);
+  for (let i = 0; i < count; i += 1) {
+    items[i] = {
+      id: columns[0][i],
+      account_id: columns[1][i],
+      title: columns[2][i],
+      created_at: Number(buf.readBigInt64LE(offsets[3] + 8 * i))
+    };
+  }
+  return { ok: '1', count: String(count), degraded: flags & 1 ? '1' : '0', items };
+}
+
 function markSuccess() {
   circuit.consecutiveFailures = 0;
   circuit.openUntil = 0;
@@ -180,15 +221,19 @@ function postFormOnce(path, payload) {
       agent,
       headers: {
         'Content-Type': 'application/x-www-form-urlencoded',
-        'Content-Length': Buffer.byteLength(body)
+        'Content-Length': Buffer.byteLength(body),
+        // kvsd drops the request (and its peer calls) once this passes.
+        'X-Kvs-Deadline': String(startedAt + hardTimeoutMs)
       }
     }, (res) => {
-      let data = '';
+      const chunks = [];
       res.on('data', (chunk) => {
-        data += chunk;
+        chunks.push(chunk);
       });
       res.on('end', () => {
-        const form = formDecode(data);
+        const data = Buffer.concat(chunks);
+        const columnar = String(res.headers['content-type'] || '').startsWith(COLUMNAR_TYPE);
+        const form = (columnar && columnsDecode(data)) || formDecode(data.toString('utf8'));
         if ((res.statusCode || 500) >= 400 || form.ok !== '1') {
           const err = new Error(form.error || 'kvs error');
           finishErr(err, res.statusCode || 500, form);
@@ -278,7 +323,10 @@ async function getPost(id) {
 }
 
 async function listTitles(limit) {
-  const r = await postForm('/post/titles', { limit }, { idempotent: true });
+  const r = await postForm('/post/titles', { limit, format: 'columnar' }, { idempotent: true });
+  if (r.items) {
+    return r.items;
+  }
   const count = Number(r.count || 0);
   const out = [];
   for (let i = 0; i < count; i += 1) {